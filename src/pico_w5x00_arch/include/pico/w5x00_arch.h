@@ -14,6 +14,8 @@ extern "C" {
 #endif
 
 #include "w5x00.h"                  // LWK: w5x00-driver, replace with ioLibrary glue?
+#include "w5x00_tcp.h"
+#include "w5x00_udp.h"
 #include "pico/async_context.h"
 
 #ifdef PICO_W5X00_ARCH_HEADER
@@ -202,6 +204,33 @@ void w5x00_arch_set_async_context(async_context_t *context);
  */
 async_context_t *w5x00_arch_init_default_async_context(void);
 
+/*!
+ * \brief Add another W5X00 chip
+ * \ingroup pico_w5x00_arch
+ *
+ * The chip set up by \ref w5x00_arch_init is \c w5x00_state. Each further chip has its own \c w5x00_t,
+ * SPI port, pins, DMA channels and (if lwIP is enabled) netif, named e1, e2 and so on. The \c w5x00_arch_*
+ * connection functions only act on \c w5x00_state, use the w5x00.h API with \p self for the others.
+ *
+ * \note Up to \c W5X00_MAX_INSTANCES chips may be used, and must all be the same type. The chips are
+ * accessed one at a time, under the async_context lock, and the driver waits for each SPI transfer
+ * to finish before it starts the next. So two chips on separate SPI ports don't run in parallel,
+ * and between them they get about the throughput of one.
+ *
+ * \param self the state for the chip, which must stay valid until \ref w5x00_arch_remove_instance
+ * \param config the SPI port and pins the chip is wired to
+ * \return 0 if the initialization is successful, an error code otherwise \see pico_error_codes
+ */
+int w5x00_arch_add_instance(w5x00_t *self, const w5x00_hw_config_t *config);
+
+/*!
+ * \brief Remove a chip added with \ref w5x00_arch_add_instance
+ * \ingroup pico_w5x00_arch
+ *
+ * \param self the state for the chip
+ */
+void w5x00_arch_remove_instance(w5x00_t *self);
+
 /*!
  * \brief Perform any processing required by the \c w5x00_driver or the TCP/IP stack
  * \ingroup pico_w5x00_arch
@@ -361,6 +390,47 @@ int w5x00_arch_ethernet_connect_timeout_ms(uint32_t timeout);
  */
 int w5x00_arch_ethernet_connect_async();
 
+/*!
+ * \brief Set a callback for the ethernet cable being plugged in or pulled out
+ * \ingroup pico_w5x00_arch
+ *
+ * The PHY is checked every \c W5X00_LINK_POLL_MS. Once \ref w5x00_arch_ethernet_connect_async (or one of the blocking
+ * variants) has been called the lwIP netif link follows it, so DHCP restarts as soon as the cable comes back.
+ * The callback is called from the async_context with its lock held.
+ *
+ * \param cb the function to call when the link goes up or down, or NULL for none
+ * \param arg passed to \p cb
+ */
+void w5x00_arch_set_link_callback(w5x00_link_cb_t cb, void *arg);
+
+/*!
+ * \brief Get the speed of the ethernet link
+ * \ingroup pico_w5x00_arch
+ *
+ * \return the speed in Mbit/s, 10 or 100, or 0 if the link is down
+ */
+uint w5x00_arch_ethernet_link_speed(void);
+
+/*!
+ * \brief Get the duplex mode of the ethernet link
+ * \ingroup pico_w5x00_arch
+ *
+ * \return true if the link is up and full duplex
+ */
+bool w5x00_arch_ethernet_link_full_duplex(void);
+
+/*!
+ * \brief Get the driver's performance counters
+ * \ingroup pico_w5x00_arch
+ *
+ * The counters cover frames and bytes in each direction, pbuf allocation and send failures, SPI and DMA traffic,
+ * interrupts and polls, the frames handled per wakeup, and how long the lock has been held. They are also mirrored into the lwIP
+ * \c MIB2_STATS_NETIF_* counters of the netif when lwIP is built with \c MIB2_STATS.
+ *
+ * \param stats filled in with a snapshot of the counters for the first chip
+ */
+void w5x00_arch_get_stats(w5x00_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
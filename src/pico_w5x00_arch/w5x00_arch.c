@@ -11,6 +11,7 @@
 #include "pico/unique_id.h"
 #include "w5x00.h"  // LWK: w5x00-driver, replace with ??
 #include "pico/w5x00_arch.h"
+#include "pico/w5x00_driver.h"
 // #include "w5x00_ll.h"  // LWK: w5x00-driver, replace with ??
 
 #if PICO_W5X00_ARCH_DEBUG_ENABLED
@@ -25,6 +26,20 @@ void w5x00_arch_set_async_context(async_context_t *context) {
     async_context = context;
 }
 
+int w5x00_arch_add_instance(w5x00_t *self, const w5x00_hw_config_t *config) {
+    assert(async_context);
+    if (!w5x00_driver_init_instance(async_context, self, config)) {
+        return PICO_ERROR_GENERIC;
+    }
+    w5x00_ethernet_set_up(self, true);
+    return 0;
+}
+
+void w5x00_arch_remove_instance(w5x00_t *self) {
+    assert(self != &w5x00_state);
+    w5x00_driver_deinit_instance(async_context, self);
+}
+
 void w5x00_arch_enable_ethernet(void) {
     assert(w5x00_is_initialized(&w5x00_state));
     w5x00_ethernet_set_up(&w5x00_state, true);
@@ -65,6 +80,22 @@ static const char* w5x00_tcpip_link_status_name(int status)
 }
 #endif
 
+void w5x00_arch_set_link_callback(w5x00_link_cb_t cb, void *arg) {
+    w5x00_set_link_callback(&w5x00_state, cb, arg);
+}
+
+uint w5x00_arch_ethernet_link_speed(void) {
+    return w5x00_ethernet_link_speed(&w5x00_state);
+}
+
+bool w5x00_arch_ethernet_link_full_duplex(void) {
+    return w5x00_ethernet_link_full_duplex(&w5x00_state);
+}
+
+void w5x00_arch_get_stats(w5x00_stats_t *stats) {
+    w5x00_get_stats(&w5x00_state, stats);
+}
+
 int w5x00_arch_ethernet_connect_async() {
     // Connect to ethernet
     return w5x00_ethernet_join(&w5x00_state);
@@ -16,6 +16,7 @@
 
 #include "pico.h"
 #include "pico/async_context.h"
+#include "w5x00.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,6 +39,29 @@ bool w5x00_driver_init(async_context_t *context);
 */
 void w5x00_driver_deinit(async_context_t *context);
 
+/*! \brief Initializes the lower level w5x00_driver for an additional chip
+ *  \ingroup pico_w5x00_driver
+ *
+ * \ref w5x00_driver_init sets up \c w5x00_state, wired as given by the \c W5X00_SPI_* and \c W5X00_GPIO_* defines.
+ * Further chips (up to \c W5X00_MAX_INSTANCES in total) each have their own \c w5x00_t, SPI port, pins and DMA channels.
+ * All the chips must use the same async_context, as the WIZnet ioLibrary they share is serialised by its lock.
+ * Only one chip is accessed at a time, so the chips share the SPI time even on separate SPI ports.
+ *
+ * \param context the async_context instance that provides the abstraction for handling asynchronous work.
+ * \param self the state for the chip, which must stay valid until \ref w5x00_driver_deinit_instance
+ * \param config the SPI port and pins the chip is wired to
+ * \return true if the initialization succeeded
+*/
+bool w5x00_driver_init_instance(async_context_t *context, w5x00_t *self, const w5x00_hw_config_t *config);
+
+/*! \brief De-initialize a chip added with \ref w5x00_driver_init_instance
+ *  \ingroup pico_w5x00_driver
+ *
+ * \param context the async_context the chip was added to
+ * \param self the state for the chip
+*/
+void w5x00_driver_deinit_instance(async_context_t *context, w5x00_t *self);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,8 +1,12 @@
 #ifndef W5X00_INCLUDED_W5X00_H
 #define W5X00_INCLUDED_W5X00_H
 
+#include "wizchip_conf.h"
 #include "w5x00_config.h"
 #include "hardware/dma.h"
+#include "hardware/spi.h"
+#include "pico/async_context.h"
+#include "pico/sem.h"
 
 #if W5X00_LWIP
 #include "lwip/netif.h"
@@ -29,44 +33,382 @@
 #define W5X00_LINK_BADAUTH      (-3)    ///< Authenticatation failure
 //!\}
 
+// Location of a socket's TX/RX ring within chip memory, cached at bring-up so ring
+// accesses don't need to read the buffer size registers
+typedef struct _w5x00_sn_buf_t {
+    uint16_t tx_base;
+    uint16_t tx_size;
+    uint16_t rx_base;
+    uint16_t rx_size;
+} w5x00_sn_buf_t;
+
+// RX priority classes, see w5x00_rx_rule_t.prio
+#define W5X00_RX_PRIO_BULK      (0)
+#define W5X00_RX_PRIO_HIGH      (1)
+#define W5X00_RX_PRIO_CLASSES   (2)
+
+// Counters for each RX priority class
+typedef struct _w5x00_rx_prio_stats_t {
+    uint32_t frames;        // passed to netif->input
+    uint32_t drops;         // no pbuf, or refused by netif->input
+    uint32_t latency_max_us;    // longest time from INTn until netif->input
+} w5x00_rx_prio_stats_t;
+
+// Frames handled per wakeup, a wakeup lasting from INTn firing until the RX buffer is empty
+typedef struct _w5x00_wakeup_stats_t {
+    uint32_t wakeups;
+    uint32_t frames;
+    uint16_t last;
+    uint16_t max;
+} w5x00_wakeup_stats_t;
+
+// Driver counters, see w5x00_get_stats
+typedef struct _w5x00_stats_t {
+    uint32_t rx_frames;
+    uint32_t rx_bytes;
+    uint32_t rx_pbuf_fail;      // frames dropped because no pbuf could be allocated
+    uint32_t rx_errors;         // times the RX ring was out of step and had to be flushed
+    uint32_t rx_input_fail;     // frames refused by netif->input
+    uint32_t rx_mcast_filtered; // multicast frames dropped as no group on their MAC has been joined
+    uint32_t rx_rule_filtered;  // frames dropped by the w5x00_set_rx_filter rules
+    uint32_t rx_bcast_limited;  // broadcasts dropped by the w5x00_set_broadcast_limit rate limit
+    // The chip drops frames silently when its RX buffer is full, these show how close it came
+    uint16_t rx_occupancy_max;  // most bytes seen waiting in the RX buffer
+    uint32_t rx_buf_full;       // frames read while the RX buffer had no room for another full size frame
+    uint32_t poll_latency_max_us;   // longest time from INTn firing until the RX buffer was read
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    uint32_t tx_fail;           // w5x00_send_ethernet failures
+    uint32_t spi_bytes;         // bytes moved over SPI in either direction
+    uint32_t spi_transactions;  // chip selects, each one costs a 3 byte address/control header
+    uint32_t dma_transfers;
+    uint32_t copy_bytes;        // frame bytes copied in RAM by the driver rather than going straight to/from SPI
+    uint32_t irqs;              // INTn interrupts taken
+    uint32_t polls;             // runs of w5x00_poll_func, polls / irqs is the polls per interrupt
+    w5x00_wakeup_stats_t wakeup;
+    // Time the lock was held, shared by all the chips as they use the same lock
+    uint64_t lock_us;
+    uint32_t lock_max_us;
+    uint32_t lock_acquires;     // outermost acquisitions, nested ones are free
+    // Time the SPI bus lock was held, see w5x00_bus_enter
+    uint64_t bus_us;
+    uint32_t bus_max_us;
+    uint32_t bus_acquires;      // outermost acquisitions, about one per frame or API call
+    uint32_t bus_nested;        // acquisitions with the bus already held, mostly the ioLibrary's per register ones
+    // Time from INTn firing until a frame is passed to w5x00_cb_process_ethernet. While the interrupt
+    // is masked for NAPI polling it's measured from the start of the poll instead, so reads low
+    uint32_t rx_latency[W5X00_RX_LATENCY_BUCKETS];
+    w5x00_rx_prio_stats_t rx_prio[W5X00_RX_PRIO_CLASSES];
+} w5x00_stats_t;
+
+// Early RX filter rule, see w5x00_set_rx_filter. A frame matches when all the fields that are set match.
+// Rules only see the first W5X00_RX_PEEK_LEN bytes of a frame, unless W5X00_RX_DRAIN has read it all
+typedef struct _w5x00_rx_rule_t {
+    uint16_t ethertype;     // 0 matches any
+    uint8_t ip_proto;       // IPv4 protocol, 0 matches any
+    uint8_t offset;         // of the 32 bit big-endian word compared with match under mask
+    uint16_t dst_port;      // UDP or TCP destination port, 0 matches any
+    bool accept;            // what to do with a matching frame
+    uint8_t prio;           // class of accepted frames, W5X00_RX_PRIO_HIGH ones are delivered ahead of bulk ones
+    uint32_t match;
+    uint32_t mask;          // 0 skips the comparison
+} w5x00_rx_rule_t;
+
+// The SPI port and pins a chip is wired to
+typedef struct _w5x00_hw_config_t {
+    spi_inst_t *spi;
+    uint sck_pin;
+    uint mosi_pin;
+    uint miso_pin;
+    uint csn_pin;
+    uint intn_pin;
+    uint rstn_pin;
+} w5x00_hw_config_t;
+
+// The wiring given by the W5X00_SPI_* and W5X00_GPIO_* defines, used for w5x00_state
+#define W5X00_HW_CONFIG_DEFAULT { \
+    .spi = W5X00_SPI_PORT, \
+    .sck_pin = W5X00_SPI_SCK_PIN, \
+    .mosi_pin = W5X00_SPI_MOSI_PIN, \
+    .miso_pin = W5X00_SPI_MISO_PIN, \
+    .csn_pin = W5X00_SPI_CSN_PIN, \
+    .intn_pin = W5X00_GPIO_INTN_PIN, \
+    .rstn_pin = W5X00_GPIO_RSTN_PIN, \
+}
+
+struct _w5x00_t;
+// Called from the async_context when the PHY link goes up or down
+typedef void (*w5x00_link_cb_t)(struct _w5x00_t *self, bool up, void *arg);
+// Called from w5x00_poll_func with the (already cleared) Sn_IR bits of a hardware socket. The bus
+// isn't held, so the handler must take it for any access to the chip
+typedef void (*w5x00_sn_handler_t)(struct _w5x00_t *self, uint8_t sn, uint8_t ir, void *param);
+
 typedef struct _w5x00_t {
+    w5x00_hw_config_t hw;
+    uint8_t idx;    // instance number, also used to name the netif and derive the mac
+
+    // set once the chip is up, w5x00_poll_func is only run when this isn't NULL
+    void (*poll)(struct _w5x00_t *self);
+    async_when_pending_worker_t poll_worker;
+    async_at_time_worker_t coalesce_worker;
+    async_at_time_worker_t napi_worker;
+    // set by the GPIO IRQ, so the poll worker knows to open a coalescing window
+    volatile bool irq_pending;
+    // when the frames now being received were signalled, for w5x00_stats_t.rx_latency
+    volatile uint32_t rx_start_us;
+    // a coalescing window is open, the IRQ stays disabled until it closes
+    bool coalescing;
+
     int8_t dma_tx;
     int8_t dma_rx;
     dma_channel_config dma_channel_config_tx;
     dma_channel_config dma_channel_config_rx;
+    // released by the DMA IRQ when a burst ends, w5x00_spi_wait_burst blocks on it
+    semaphore_t dma_done;
+    // actual SPI clock in use
+    uint32_t spi_baudrate;
 
     uint8_t itf_state;
     uint32_t ethernet_link_state;
+    // w5x00_ethernet_join has been called, so the netif follows the PHY link
+    bool joined;
+    // MAC filtering is off, see w5x00_set_promiscuous
+    bool promiscuous;
+
+    // PHY link monitoring, see w5x00_set_link_callback
+    async_at_time_worker_t link_worker;
+    uint8_t phy_status;     // last W5X00_PHY_* bits read, W5X00_PHY_UNKNOWN to report the next read regardless
+    w5x00_link_cb_t link_cb;
+    void *link_cb_arg;
 
-    uint8_t eth_frame[1514];
+    // RX ring pointer and length of the payload of the frame being received
+    uint16_t rx_ptr;
+    uint16_t rx_len;
+    // If not NULL the frame being received has already been read into RAM here
+    const uint8_t *rx_src;
+    // Otherwise the MACRAW length and the first rx_peek_len bytes of the frame are here
+    uint8_t rx_head[2 + W5X00_RX_PEEK_LEN];
+    uint16_t rx_peek_len;
+    // Set while rx_head holds rx_head_len bytes of the next frame at rx_head_rd, read ahead with
+    // Sn_RX_RSR while the bus was held for something else. Only good until the end of the poll
+    bool rx_head_valid;
+    uint16_t rx_head_rsr;
+    uint16_t rx_head_rd;
+    uint16_t rx_head_len;
+
+    // Broadcast token bucket, see w5x00_set_broadcast_limit. The tokens are kept as time, each
+    // broadcast costing bcast_cost_us
+    uint32_t bcast_cost_us;
+    uint32_t bcast_credit_max_us;
+    uint32_t bcast_credit_us;
+    uint32_t bcast_last_us;
+
+    // early RX filter, see w5x00_set_rx_filter
+    w5x00_rx_rule_t rx_rules[W5X00_RX_FILTER_RULES];
+    uint8_t rx_rule_count;
+    bool rx_rule_default_accept;
+    bool rx_prio_used;      // some rule gives a high priority
+    uint8_t rx_prio;        // class of the frame being passed to w5x00_cb_process_ethernet
+
+    // Multicast MACs lwIP has subscribed to, see w5x00_ethernet_update_multicast_filter
+    struct {
+        uint8_t mac[6];
+        uint8_t refs;
+    } mcast_filter[W5X00_MCAST_FILTER_LEN];
+    uint8_t mcast_overflow;     // subscriptions that didn't fit, all multicast is let through while there are any
+
+    // Pipelined transmit. Frames are written into the TX ring beyond Sn_TX_WR, and each is
+    // committed and sent once the SEND of the one before it has completed
+    uint16_t tx_ptr;    // end of the last frame written to the ring
+    uint16_t tx_wr;     // last value written to Sn_TX_WR
+    uint16_t tx_rd;     // start of the oldest frame still in the ring
+    bool tx_synced;     // the pointers above have been read from the chip
+    bool tx_busy;       // a SEND is in progress
+    uint8_t tx_queue_head;
+    uint8_t tx_queue_count;
+    uint16_t tx_queue[W5X00_TX_QUEUE_LEN]; // end pointers of frames waiting to be sent
+
+    // per poll receive budget
+    uint16_t rx_budget_frames;
+    uint32_t rx_budget_bytes;
+    // the budget ran out before the RX buffer was empty
+    bool rx_more;
+
+    // interrupt coalescing, see w5x00_set_irq_coalesce
+    uint16_t coalesce_frames;
+    uint32_t coalesce_us;
+    uint32_t coalesce_window_us;    // current window, adapted to the frame rate
+    uint16_t wakeup_frames;         // frames handled so far in this wakeup
+    w5x00_stats_t stats;
+
+    // Under load the interrupt is masked and the RX buffer is polled until it runs dry,
+    // see w5x00_set_napi_thresholds
+    bool napi_polling;
+    uint16_t napi_enter_frames;
+    uint16_t napi_exit_polls;
+    uint16_t napi_empty_polls;     // consecutive empty polls so far
+
+    #if W5X00_RX_DRAIN
+    uint8_t rx_drain_buf[W5X00_RX_DRAIN_BUF_SIZE];
+    // MACRAW length of the frame at rx_drain_next_ptr, from the end of a burst that stopped part way
+    // into it. 0 if not known
+    uint16_t rx_drain_next_len;
+    uint16_t rx_drain_next_ptr;
+    // Frames a burst read past the frame or byte budget, left in rx_drain_buf at rx_drain_held_off
+    // for the next poll rather than read again. They start at rx_drain_held_ptr. 0 if none
+    uint16_t rx_drain_held;
+    uint16_t rx_drain_held_off;
+    uint16_t rx_drain_held_ptr;
+    #endif
+
+    // buffer size of each socket in KB, TX sizes followed by RX sizes as for CW_INIT_WIZCHIP
+    uint8_t sn_size[2 * _WIZCHIP_SOCK_NUM_];
+    w5x00_sn_buf_t sn_buf[_WIZCHIP_SOCK_NUM_];
+
+    // hardware sockets handed out by w5x00_socket_alloc, socket 0 is always the MACRAW socket
+    uint8_t sn_in_use;
+    struct {
+        w5x00_sn_handler_t fn;
+        void *param;
+    } sn_handler[_WIZCHIP_SOCK_NUM_];
 
     bool initted;
 
     #if W5X00_LWIP
     // lwIP data
     struct netif netif;
+    // bulk frames held back until w5x00_cb_rx_batch_done
+    struct pbuf *rx_bulk[W5X00_RX_BULK_QUEUE_LEN];
+    uint8_t rx_bulk_count;
     #if LWIP_IPV4 && LWIP_DHCP
     struct dhcp dhcp_client;
     #endif
+    #if W5X00_PIPE && LWIP_IPV4
+    // the netif's address, copied with the bus held for core 1 which can't read the netif
+    uint32_t pipe_ip4_addr;
+    #endif
     #endif
 
     // mac from otp (or from w5x00_hal_generate_laa_mac if not set)
     uint8_t mac[6];
 } w5x00_t;
 
+// The first chip, wired as given by the W5X00_SPI_* and W5X00_GPIO_* defines
 extern w5x00_t w5x00_state;
-extern void (*w5x00_poll)(void);
-extern uint32_t w5x00_sleep;
+
+// The ioLibrary is global, so its SPI callbacks talk to whichever chip is active. Every
+// entry point that touches the chip makes its own chip active for the duration
+extern w5x00_t *w5x00_active;
+
+static inline w5x00_t *w5x00_activate(w5x00_t *self) {
+    w5x00_t *prev = w5x00_active;
+    w5x00_active = self;
+    return prev;
+}
+
+// The SPI bus lock, which the ioLibrary takes around each register access. Holding it over a whole
+// operation makes those nested acquisitions nearly free. Recursive
+void w5x00_bus_enter(void);
+void w5x00_bus_exit(void);
+
+// Take the lock and make self the active chip. Returns the chip that was active, which is handed
+// back to W5X00_EXIT to restore it, e.g. w5x00_t *prev = W5X00_ENTER(self); ... W5X00_EXIT(prev);
+static inline w5x00_t *w5x00_enter(w5x00_t *self) {
+    W5X00_THREAD_ENTER
+    return w5x00_activate(self);
+}
+
+static inline void w5x00_exit(w5x00_t *prev) {
+    w5x00_activate(prev);
+    W5X00_THREAD_EXIT
+}
+
+// As w5x00_enter, and hold the bus for an operation on the chip. Nothing that may call into lwIP
+// should use it, with W5X00_PIPE lwIP can end up waiting for core 1 which needs the bus
+static inline w5x00_t *w5x00_enter_bus(w5x00_t *self) {
+    w5x00_t *prev = w5x00_enter(self);
+    w5x00_bus_enter();
+    return prev;
+}
+
+static inline void w5x00_exit_bus(w5x00_t *prev) {
+    w5x00_bus_exit();
+    w5x00_exit(prev);
+}
+
+#define W5X00_ENTER(self) w5x00_enter(self)
+#define W5X00_EXIT(prev) w5x00_exit(prev)
+#define W5X00_BUS_ENTER(self) w5x00_enter_bus(self)
+#define W5X00_BUS_EXIT(prev) w5x00_exit_bus(prev)
 
 // void w5x00_init(w5x00_t *self);
 // void w5x00_deinit(w5x00_t *self);
 
-int w5x00_send_ethernet(w5x00_t *self, size_t len, const void *buf, bool is_pbuf);
 int w5x00_ethernet_link_status(w5x00_t *self);
 
+// If is_pbuf is true, buf is a struct pbuf chain which is written straight into the chip. With
+// W5X00_PIPE the frame is queued for core 1, and -W5X00_EAGAIN means there was no room to queue it
 int w5x00_send_ethernet(w5x00_t *self, size_t len, const void *buf, bool is_pbuf);
-uint16_t wiznet5k_recv_ethernet(w5x00_t *self, const uint8_t *buf);
+uint16_t wiznet5k_recv_ethernet(w5x00_t *self);
+// Reads part of the frame currently being passed to w5x00_cb_process_ethernet
+void w5x00_read_ethernet(w5x00_t *self, uint16_t offset, uint8_t *buf, uint16_t len);
+
+// Limit how much is received in one poll, so a busy network can't starve other work
+void w5x00_set_rx_budget(w5x00_t *self, uint16_t max_frames, uint32_t max_bytes);
+
+// Hold off polling for up to max_us after an interrupt, aiming for max_frames per wakeup. max_us of 0 disables it
+void w5x00_set_irq_coalesce(w5x00_t *self, uint16_t max_frames, uint32_t max_us);
+
+// Poll rather than take interrupts once a wakeup has handled enter_frames frames, until exit_empty_polls
+// polls in a row find nothing. Each poll goes through the async_context's timer list, so its other work
+// runs in between. enter_frames of 0 always uses interrupts
+void w5x00_set_napi_thresholds(w5x00_t *self, uint16_t enter_frames, uint16_t exit_empty_polls);
+
+// Set how the chip's buffer memory is split between the MACRAW socket (0) and the hardware sockets.
+// tx_kb and rx_kb have an entry for each socket. Must be called before the interface is brought up
+int w5x00_set_buffer_partition(w5x00_t *self, const uint8_t *tx_kb, const uint8_t *rx_kb);
+
+// Claim a hardware socket with buffer memory, returning its number or a negative error.
+// The handler is called from the async_context when the socket raises an interrupt
+int w5x00_socket_alloc(w5x00_t *self, w5x00_sn_handler_t handler, void *param);
+void w5x00_socket_free(w5x00_t *self, uint8_t sn);
+
+// Raw access to a socket's TX/RX ring at the given (unwrapped) pointer
+void w5x00_sn_write_tx(w5x00_t *self, uint8_t sn, uint16_t ptr, const uint8_t *buf, uint16_t len);
+void w5x00_sn_read_rx(w5x00_t *self, uint8_t sn, uint16_t ptr, uint8_t *buf, uint16_t len);
+
+
+// Get a snapshot of the driver counters. To measure the cost of a workload reset the counters, run it and
+// divide the spi_*, copy_bytes, lock_acquires and bus_* counts by the frames handled
+void w5x00_get_stats(w5x00_t *self, w5x00_stats_t *stats);
+void w5x00_reset_stats(w5x00_t *self);
+// Upper bound in us of the RX latency that percent of the frames in stats were delivered within
+uint32_t w5x00_stats_rx_latency_percentile(const w5x00_stats_t *stats, uint percent);
+// Frame bytes per second the SPI bus could carry at spi_hz, with the per frame bus overhead seen in stats.
+// This is the bus bound limit, a workload measured at one clock predicts the ceiling at another
+uint32_t w5x00_stats_spi_throughput_limit(const w5x00_stats_t *stats, uint32_t spi_hz);
+
+// Call cb whenever the PHY link goes up or down
+void w5x00_set_link_callback(w5x00_t *self, w5x00_link_cb_t cb, void *arg);
+// Speed of the link in Mbit/s, 0 if it's down
+uint w5x00_ethernet_link_speed(w5x00_t *self);
+bool w5x00_ethernet_link_full_duplex(w5x00_t *self);
+
+// Admit at most per_second broadcast frames, allowing bursts of up to burst. ARP for our address and DHCP
+// are always admitted. Broadcasts the w5x00_set_rx_filter rules drop don't count. A per_second of 0 admits
+// all broadcasts
+void w5x00_set_broadcast_limit(w5x00_t *self, uint32_t per_second, uint32_t burst);
+
+// Drop unwanted frames before their payload is read from the chip. The first of the count rules that matches
+// decides, frames matching none are accepted if default_accept is true. A count of 0 turns the filter off
+int w5x00_set_rx_filter(w5x00_t *self, const w5x00_rx_rule_t *rules, uint count, bool default_accept);
+
+// Add or remove a reference to a multicast MAC. Multicast frames to MACs with no references are dropped
+int w5x00_ethernet_update_multicast_filter(w5x00_t *self, const uint8_t mac[6], bool add);
 
+// Receive every frame on the wire rather than only those for our MAC, for packet capture. The broadcast
+// limit and RX filter still apply. Unicast frames for other MACs are captured, then dropped
+int w5x00_set_promiscuous(w5x00_t *self, bool on);
 
 void w5x00_ethernet_set_up(w5x00_t *self, bool up);
 int w5x00_ethernet_get_mac(w5x00_t *self, uint8_t mac[6]);
@@ -81,7 +423,9 @@ static inline bool w5x00_is_initialized(w5x00_t *self) {
 
 void w5x00_cb_tcpip_init(w5x00_t *self);
 void w5x00_cb_tcpip_deinit(w5x00_t *self);
-void w5x00_cb_process_ethernet(void *cb_data, size_t len, const uint8_t *buf);
+void w5x00_cb_process_ethernet(void *cb_data, size_t len);
+// Called after each batch of frames has been passed to w5x00_cb_process_ethernet
+void w5x00_cb_rx_batch_done(w5x00_t *self);
 void w5x00_cb_tcpip_set_link_up(w5x00_t *self);
 void w5x00_cb_tcpip_set_link_down(w5x00_t *self);
 int w5x00_tcpip_link_status(w5x00_t *self);
@@ -0,0 +1,44 @@
+#ifndef W5X00_INCLUDED_W5X00_CAPTURE_H
+#define W5X00_INCLUDED_W5X00_CAPTURE_H
+
+#include "w5x00.h"
+
+// Directions for w5x00_capture_start
+#define W5X00_CAPTURE_RX    (1)
+#define W5X00_CAPTURE_TX    (2)
+
+// Receives the pcap stream from w5x00_capture_write_pcap
+typedef void (*w5x00_capture_write_fn_t)(const void *data, size_t len, void *arg);
+
+#if W5X00_CAPTURE && W5X00_LWIP
+
+// The chip being captured, NULL when no capture is running
+extern w5x00_t *w5x00_capture_target;
+
+void w5x00_capture_frame(uint8_t dir, const struct pbuf *p);
+
+// Tap point for frames passing through the netif, costs a compare when the chip isn't being captured
+static inline void w5x00_capture_tap(w5x00_t *self, uint8_t dir, const struct pbuf *p) {
+    if (w5x00_capture_target == self) {
+        w5x00_capture_frame(dir, p);
+    }
+}
+
+#else
+
+#define w5x00_capture_tap(self, dir, p) ((void)0)
+
+#endif
+
+// Start capturing frames of self going in dirs (W5X00_CAPTURE_RX | W5X00_CAPTURE_TX) into the ring. Only the
+// first snaplen bytes of each frame are kept, up to W5X00_CAPTURE_SNAPLEN. If ethertype isn't 0 only frames
+// of that type are captured. Once the ring is full the oldest frames are overwritten
+int w5x00_capture_start(w5x00_t *self, uint8_t dirs, uint16_t snaplen, uint16_t ethertype);
+void w5x00_capture_stop(void);
+// Stream the frames in the ring as a pcap file, emptying it. Capture can carry on meanwhile.
+// Returns the number of frames written
+uint w5x00_capture_write_pcap(w5x00_capture_write_fn_t fn, void *arg);
+// Frames overwritten before they were written out
+uint32_t w5x00_capture_lost(void);
+
+#endif
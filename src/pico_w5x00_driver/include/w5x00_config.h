@@ -8,8 +8,200 @@
 #define W5X00_IOCTL_TIMEOUT_US (500000)
 #endif
 
-#ifndef W5X00_SLEEP_MAX
-#define W5X00_SLEEP_MAX (50)
+// SPI clock used to talk to the chip before (or instead of) calibration
+#ifndef W5X00_SPI_BAUD_INIT
+#define W5X00_SPI_BAUD_INIT (5000 * 1000)
+#endif
+
+// Ceiling for the SPI clock. The chips are rated faster (W5500 80 MHz, W5100S 70 MHz), but reads are only
+// reliable up to about 33 MHz. Lower this for boards with poor signal integrity
+#ifndef W5X00_SPI_BAUD_MAX
+#define W5X00_SPI_BAUD_MAX (33 * 1000 * 1000)
+#endif
+
+// Ramp the SPI clock up at startup, up to W5X00_SPI_BAUD_MAX, until writes to chip memory stop reading
+// back correctly. Otherwise the chip is run at W5X00_SPI_BAUD_INIT
+#ifndef W5X00_SPI_CALIBRATE
+#define W5X00_SPI_CALIBRATE (0)
+#endif
+
+// Number of times the test pattern has to read back correctly for a clock to be accepted
+#ifndef W5X00_SPI_CALIBRATE_ROUNDS
+#define W5X00_SPI_CALIBRATE_ROUNDS (8)
+#endif
+
+// Socket buffer memory in each direction, in KB
+#if _WIZCHIP_ == W5500
+#define W5X00_CHIP_BUF_KB (16)
+#else
+#define W5X00_CHIP_BUF_KB (8)
+#endif
+
+// Number of hardware sockets (1 onwards) the chip's own TCP/IP stack handles alongside the
+// MACRAW socket used by lwIP, and how much buffer memory each gets
+#ifndef W5X00_HW_SOCKETS
+#define W5X00_HW_SOCKETS (0)
+#endif
+
+#ifndef W5X00_HW_SOCKET_BUF_KB
+#define W5X00_HW_SOCKET_BUF_KB (2)
+#endif
+
+#ifndef W5X00_MACRAW_BUF_KB
+#if W5X00_HW_SOCKETS
+#define W5X00_MACRAW_BUF_KB (W5X00_CHIP_BUF_KB / 2)
+#else
+#define W5X00_MACRAW_BUF_KB (W5X00_CHIP_BUF_KB)
+#endif
+#endif
+
+// Number of frames that can be written to the chip while waiting for the previous SEND to complete
+#ifndef W5X00_TX_QUEUE_LEN
+#define W5X00_TX_QUEUE_LEN (4)
+#endif
+
+// Which of the DMA IRQs (0 or 1) signals the end of an SPI burst
+#ifndef W5X00_DMA_IRQ_NUM
+#define W5X00_DMA_IRQ_NUM (1)
+#endif
+
+#ifndef W5X00_MAX_FRAME_SIZE
+#define W5X00_MAX_FRAME_SIZE (1514)
+#endif
+
+// Maximum number of frames and bytes received per poll before yielding to other work
+#ifndef W5X00_RX_POLL_MAX_FRAMES
+#define W5X00_RX_POLL_MAX_FRAMES (32)
+#endif
+
+#ifndef W5X00_RX_POLL_MAX_BYTES
+#define W5X00_RX_POLL_MAX_BYTES (16 * 1024)
+#endif
+
+// Drain all pending frames with one burst read into a RAM buffer, rather than reading
+// each frame separately. Cheaper on the bus for small frames at the cost of the buffer
+#ifndef W5X00_RX_DRAIN
+#define W5X00_RX_DRAIN (0)
+#endif
+
+#ifndef W5X00_RX_DRAIN_BUF_SIZE
+#define W5X00_RX_DRAIN_BUF_SIZE (2048)
+#endif
+
+// Bytes at the start of each frame read along with its length, so the frame can be filtered without
+// another SPI transaction. Covers the Ethernet and IPv4 headers and the UDP/TCP ports
+#ifndef W5X00_RX_PEEK_LEN
+#define W5X00_RX_PEEK_LEN (42)
+#endif
+
+// Rules in the early RX filter, see w5x00_set_rx_filter
+#ifndef W5X00_RX_FILTER_RULES
+#define W5X00_RX_FILTER_RULES (8)
+#endif
+
+// Bulk frames held back in a poll so high priority frames read after them are delivered first,
+// see w5x00_rx_rule_t.prio. Once full the held frames are delivered
+#ifndef W5X00_RX_BULK_QUEUE_LEN
+#define W5X00_RX_BULK_QUEUE_LEN (8)
+#endif
+
+// Broadcasts admitted per second, other than ARP for our address and DHCP. 0 for no limit
+#ifndef W5X00_BCAST_RATE
+#define W5X00_BCAST_RATE (100)
+#endif
+
+// Broadcasts that can be admitted back to back before W5X00_BCAST_RATE applies
+#ifndef W5X00_BCAST_BURST
+#define W5X00_BCAST_BURST (20)
+#endif
+
+// Multicast MAC addresses that can be subscribed to before all multicast has to be let through
+#ifndef W5X00_MCAST_FILTER_LEN
+#define W5X00_MCAST_FILTER_LEN (8)
+#endif
+
+// Hardware interrupt moderation, the minimum time INTn stays deasserted after being cleared.
+// Written to INTLEVEL on the W5500 ((value + 1) * 26.7ns) and INTPTMR on the W5100S. 0 disables it
+#ifndef W5X00_INTLEVEL
+#define W5X00_INTLEVEL (0)
+#endif
+
+// Software interrupt coalescing. After INTn fires, wait up to this long before polling so one
+// wakeup services a batch of frames. 0 polls straight away
+#ifndef W5X00_IRQ_COALESCE_US
+#define W5X00_IRQ_COALESCE_US (0)
+#endif
+
+// Target number of frames per wakeup, the coalescing window is shortened when wakeups handle more
+#ifndef W5X00_IRQ_COALESCE_FRAMES
+#define W5X00_IRQ_COALESCE_FRAMES (8)
+#endif
+
+// Switch from interrupt driven to polled RX once a wakeup has handled this many frames, see
+// w5x00_set_napi_thresholds. 0 never polls
+#ifndef W5X00_NAPI_ENTER_FRAMES
+#define W5X00_NAPI_ENTER_FRAMES (0)
+#endif
+
+// Go back to interrupt driven RX after this many consecutive polls find the RX buffer empty
+#ifndef W5X00_NAPI_EXIT_EMPTY_POLLS
+#define W5X00_NAPI_EXIT_EMPTY_POLLS (1)
+#endif
+
+// Buckets in the RX latency histogram, bucket n counts frames delivered in under 2^n us
+#ifndef W5X00_RX_LATENCY_BUCKETS
+#define W5X00_RX_LATENCY_BUCKETS (16)
+#endif
+
+// How often the PHY is checked for the cable being plugged in or pulled out
+#ifndef W5X00_LINK_POLL_MS
+#define W5X00_LINK_POLL_MS (500)
+#endif
+
+// Record trace points into a ring buffer, see w5x00_trace.h. Compiled out entirely when 0
+#ifndef W5X00_TRACE
+#define W5X00_TRACE (0)
+#endif
+
+// Entries in each core's trace ring, must be a power of 2
+#ifndef W5X00_TRACE_BUF_LEN
+#define W5X00_TRACE_BUF_LEN (1024)
+#endif
+
+// Packet capture ring, see w5x00_capture.h. Needs lwIP. When no capture is running each frame
+// costs a compare, the RAM for the ring is the main cost
+#ifndef W5X00_CAPTURE
+#define W5X00_CAPTURE (0)
+#endif
+
+// Frames held in the capture ring
+#ifndef W5X00_CAPTURE_SLOTS
+#define W5X00_CAPTURE_SLOTS (32)
+#endif
+
+// Most bytes kept of each captured frame
+#ifndef W5X00_CAPTURE_SNAPLEN
+#define W5X00_CAPTURE_SNAPLEN (128)
+#endif
+
+// Run the chip from core 1 and lwIP on core 0, see w5x00_pipe.h. Needs W5X00_MAX_INSTANCES of 1
+#ifndef W5X00_PIPE
+#define W5X00_PIPE (0)
+#endif
+
+// Frames that can be waiting to go from core 1 to lwIP, must be a power of 2
+#ifndef W5X00_PIPE_RX_SLOTS
+#define W5X00_PIPE_RX_SLOTS (8)
+#endif
+
+// Frames that can be waiting to go from lwIP to core 1, must be a power of 2
+#ifndef W5X00_PIPE_TX_SLOTS
+#define W5X00_PIPE_TX_SLOTS (4)
+#endif
+
+// Number of chips the driver can have, see w5x00_driver_init_instance. They are accessed one at a time
+#ifndef W5X00_MAX_INSTANCES
+#define W5X00_MAX_INSTANCES (1)
 #endif
 
 #ifndef W5X00_LWIP
@@ -64,6 +64,7 @@ extern "C" {
 #define W5X00_EIO              (-PICO_ERROR_IO) // I/O error
 #define W5X00_EINVAL           (-PICO_ERROR_INVALID_ARG) // Invalid argument
 #define W5X00_ETIMEDOUT        (-PICO_ERROR_TIMEOUT) // Connection timed out
+#define W5X00_EAGAIN           (-PICO_ERROR_INSUFFICIENT_RESOURCES) // Resource temporarily unavailable
 
 #define w5x00_hal_pin_obj_t uint
 
@@ -134,11 +135,13 @@ void w5x00_delay_ms(uint32_t ms);
 
 void w5x00_delay_us(uint32_t us);
 
-void w5x00_schedule_internal_poll_dispatch(void (*func)(void));
+struct _w5x00_t;
 
-void w5x00_post_poll_hook(void);
+void w5x00_schedule_internal_poll_dispatch(struct _w5x00_t *self);
 
-#define W5X00_POST_POLL_HOOK w5x00_post_poll_hook();
+void w5x00_post_poll_hook(struct _w5x00_t *self);
+
+#define W5X00_POST_POLL_HOOK(self) w5x00_post_poll_hook(self);
 
 // Allow malloc and free to be changed
 #ifndef w5x00_malloc
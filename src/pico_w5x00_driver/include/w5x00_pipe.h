@@ -0,0 +1,84 @@
+#ifndef W5X00_INCLUDED_W5X00_PIPE_H
+#define W5X00_INCLUDED_W5X00_PIPE_H
+
+#include "w5x00.h"
+
+// With W5X00_PIPE set, core 1 owns the chip. It takes INTn, drains received frames into RX slots and writes
+// the frames in TX slots to the chip, while core 0 runs lwIP. Each direction is a single producer single
+// consumer ring, so the cores only meet on the SPI bus lock when core 0 touches the chip itself
+
+#if W5X00_PIPE
+
+#include "hardware/sync.h"
+
+static_assert(W5X00_MAX_INSTANCES == 1, "W5X00_PIPE only drives one chip");
+static_assert((W5X00_PIPE_RX_SLOTS & (W5X00_PIPE_RX_SLOTS - 1)) == 0, "W5X00_PIPE_RX_SLOTS must be a power of 2");
+static_assert((W5X00_PIPE_TX_SLOTS & (W5X00_PIPE_TX_SLOTS - 1)) == 0, "W5X00_PIPE_TX_SLOTS must be a power of 2");
+
+typedef struct _w5x00_pipe_slot_t {
+    uint16_t len;
+    uint8_t prio;           // RX priority class
+    uint32_t start_us;      // when INTn fired for a received frame
+    // a frame to send that's still in the pbuf chain lwIP gave us, which core 0 holds a reference to.
+    // Otherwise the frame is in data
+    const void *pbuf;
+    // a received frame keeps its 2 byte MACRAW length in front
+    uint8_t data[2 + W5X00_MAX_FRAME_SIZE];
+} w5x00_pipe_slot_t;
+
+// head is only written by the producer and tail by the consumer. The counts run freely and wrap,
+// the slot in use is the count modulo the number of slots
+typedef struct _w5x00_pipe_ring_t {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t len;
+    w5x00_pipe_slot_t *slots;
+} w5x00_pipe_ring_t;
+
+// Producer side, the next slot to fill or NULL if the ring is full
+static inline w5x00_pipe_slot_t *w5x00_pipe_ring_free(w5x00_pipe_ring_t *ring) {
+    uint32_t head = ring->head;
+    if (head - ring->tail == ring->len) {
+        return NULL;
+    }
+    // the consumer has finished with the slot before moving tail past it
+    __dmb();
+    return &ring->slots[head & (ring->len - 1)];
+}
+
+static inline void w5x00_pipe_ring_publish(w5x00_pipe_ring_t *ring) {
+    // the slot contents must be visible before the consumer can see it
+    __dmb();
+    ring->head = ring->head + 1;
+    __sev();
+}
+
+// Consumer side, the oldest filled slot or NULL if the ring is empty
+static inline w5x00_pipe_slot_t *w5x00_pipe_ring_peek(w5x00_pipe_ring_t *ring) {
+    uint32_t tail = ring->tail;
+    if (tail == ring->head) {
+        return NULL;
+    }
+    __dmb();
+    return &ring->slots[tail & (ring->len - 1)];
+}
+
+static inline void w5x00_pipe_ring_release(w5x00_pipe_ring_t *ring) {
+    __dmb();
+    ring->tail = ring->tail + 1;
+    __sev();
+}
+
+// Run the chip from core 1, e.g. with multicore_launch_core1(w5x00_pipe_core1_task). Start it before
+// bringing the interface up, it waits for the chip and never returns
+void w5x00_pipe_core1_task(void);
+
+// w5x00_pipe_core1_task in two halves, for a core 1 that has other work too. Call w5x00_pipe_core1_init
+// on core 1, then w5x00_pipe_core1_poll there until it returns false. It's then safe to sleep with
+// __wfe() until the next event, which may be INTn or core 0 queueing a frame
+void w5x00_pipe_core1_init(void);
+bool w5x00_pipe_core1_poll(void);
+
+#endif
+
+#endif
@@ -15,6 +15,8 @@ void w5x00_spi_read_burst(uint8_t *pBuf, uint16_t len);
 void w5x00_spi_write_burst(const uint8_t *pBuf, uint16_t len);
 
 int w5x00_spi_init(w5x00_t *self);
+uint w5x00_spi_set_baudrate(w5x00_t *self, uint baudrate);
+uint w5x00_spi_get_baudrate(w5x00_t *self);
 void w5x00_spi_deinit(w5x00_t *self);
 
 #endif
@@ -0,0 +1,61 @@
+#ifndef W5X00_INCLUDED_W5X00_TCP_H
+#define W5X00_INCLUDED_W5X00_TCP_H
+
+#include "w5x00.h"
+
+/*!
+ * \name TCP events
+ * \anchor W5X00_TCP_EVENT_
+ * \see w5x00_tcp_event_cb_t
+ */
+//!\{
+#define W5X00_TCP_EVENT_CONNECTED   (0x01)  ///< connection established (connect completed or a peer connected to a listening socket)
+#define W5X00_TCP_EVENT_CLOSED      (0x02)  ///< peer closed the connection
+#define W5X00_TCP_EVENT_RECV        (0x04)  ///< data is available to w5x00_tcp_recv
+#define W5X00_TCP_EVENT_ERROR       (0x08)  ///< connect or send timed out, the socket is closed
+#define W5X00_TCP_EVENT_SENT        (0x10)  ///< data was sent, there may be more room for w5x00_tcp_send
+//!\}
+
+struct _w5x00_tcp_t;
+
+// Called from the async_context with the w5x00 lock held, but not the SPI bus, so it may call back
+// into this API or into lwIP
+typedef void (*w5x00_tcp_event_cb_t)(struct _w5x00_tcp_t *tcp, uint8_t events, void *arg);
+
+// A TCP connection handled by the chip's own TCP/IP stack on one of the hardware sockets.
+// Segmentation, acknowledgement and retransmission all happen on the chip
+typedef struct _w5x00_tcp_t {
+    w5x00_t *w5x00;
+    int8_t sn;
+    bool send_busy;     // a SEND is in progress
+    uint16_t tx_ptr;    // end of the data written to the TX ring
+    uint16_t tx_wr;     // last value written to Sn_TX_WR
+    w5x00_tcp_event_cb_t event_cb;
+    void *arg;
+} w5x00_tcp_t;
+
+// Claim a hardware socket and open it for TCP on local_port (0 to pick one)
+int w5x00_tcp_open(w5x00_t *self, w5x00_tcp_t *tcp, uint16_t local_port, w5x00_tcp_event_cb_t event_cb, void *arg);
+
+// Start connecting, W5X00_TCP_EVENT_CONNECTED or W5X00_TCP_EVENT_ERROR follows
+int w5x00_tcp_connect(w5x00_tcp_t *tcp, const uint8_t ip[4], uint16_t port);
+
+// Wait for a peer to connect, W5X00_TCP_EVENT_CONNECTED follows
+int w5x00_tcp_listen(w5x00_tcp_t *tcp);
+
+// Queue up to len bytes, returning the number queued (0 if the TX buffer is full) or a negative error
+int w5x00_tcp_send(w5x00_tcp_t *tcp, const void *buf, size_t len);
+
+// Read up to len received bytes, returning the number read or a negative error
+int w5x00_tcp_recv(w5x00_tcp_t *tcp, void *buf, size_t len);
+
+// Number of received bytes waiting to be read
+size_t w5x00_tcp_recv_available(w5x00_tcp_t *tcp);
+
+// Start a graceful close, W5X00_TCP_EVENT_CLOSED follows
+int w5x00_tcp_shutdown(w5x00_tcp_t *tcp);
+
+// Close the socket immediately and release it
+void w5x00_tcp_close(w5x00_tcp_t *tcp);
+
+#endif
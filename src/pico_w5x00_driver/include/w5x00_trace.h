@@ -0,0 +1,66 @@
+#ifndef W5X00_INCLUDED_W5X00_TRACE_H
+#define W5X00_INCLUDED_W5X00_TRACE_H
+
+#include "w5x00_config.h"
+
+// Trace event ids. tools/w5x00_trace_to_chrome.py has the same table, keep them in step
+#define W5X00_TRACE_IRQ             (1)     // INTn interrupt, arg is the instance
+#define W5X00_TRACE_POLL_BEGIN      (2)     // w5x00_do_poll, arg is the instance
+#define W5X00_TRACE_POLL_END        (3)
+#define W5X00_TRACE_SPI_BEGIN       (4)     // blocking SPI burst, arg is the length
+#define W5X00_TRACE_SPI_END         (5)
+#define W5X00_TRACE_LOCK_ACQUIRE    (6)     // w5x00_thread_enter, arg is the nesting depth
+#define W5X00_TRACE_LOCK_RELEASE    (7)
+#define W5X00_TRACE_NETIF_INPUT     (8)     // frame handed to lwIP, arg is the length
+#define W5X00_TRACE_TX_BEGIN        (9)     // w5x00_send_ethernet, arg is the length
+#define W5X00_TRACE_TX_END          (10)
+
+#if W5X00_TRACE
+
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+typedef struct _w5x00_trace_entry_t {
+    uint32_t time_us;
+    uint16_t arg;
+    uint8_t event;
+    uint8_t core;
+} w5x00_trace_entry_t;
+
+// One ring per core, so the cores never contend. Each ring is only written from its own core,
+// and masking interrupts for the few stores of an entry keeps IRQ trace points from tearing it
+typedef struct _w5x00_trace_ring_t {
+    uint32_t head;  // total entries written, the ring holds the last W5X00_TRACE_BUF_LEN
+    w5x00_trace_entry_t buf[W5X00_TRACE_BUF_LEN];
+} w5x00_trace_ring_t;
+
+static_assert((W5X00_TRACE_BUF_LEN & (W5X00_TRACE_BUF_LEN - 1)) == 0, "W5X00_TRACE_BUF_LEN must be a power of 2");
+
+extern w5x00_trace_ring_t w5x00_trace_rings[NUM_CORES];
+
+static inline void w5x00_trace_record(uint8_t event, uint32_t arg) {
+    uint core = get_core_num();
+    w5x00_trace_ring_t *ring = &w5x00_trace_rings[core];
+    uint32_t save = save_and_disable_interrupts();
+    w5x00_trace_entry_t *e = &ring->buf[ring->head++ & (W5X00_TRACE_BUF_LEN - 1)];
+    e->time_us = time_us_32();
+    e->arg = (uint16_t)arg;
+    e->event = event;
+    e->core = (uint8_t)core;
+    restore_interrupts(save);
+}
+
+#define W5X00_TRACE_EVENT(event, arg) w5x00_trace_record(event, arg)
+
+#else
+
+#define W5X00_TRACE_EVENT(event, arg) ((void)0)
+
+#endif
+
+// Print the trace rings over stdio, oldest first, for tools/w5x00_trace_to_chrome.py. Does nothing without W5X00_TRACE
+void w5x00_trace_dump(void);
+// Empty the trace rings
+void w5x00_trace_clear(void);
+
+#endif
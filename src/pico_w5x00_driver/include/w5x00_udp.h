@@ -0,0 +1,75 @@
+#ifndef W5X00_INCLUDED_W5X00_UDP_H
+#define W5X00_INCLUDED_W5X00_UDP_H
+
+#include "w5x00.h"
+
+/*!
+ * \name UDP events
+ * \anchor W5X00_UDP_EVENT_
+ * \see w5x00_udp_event_cb_t
+ */
+//!\{
+#define W5X00_UDP_EVENT_RECV        (0x01)  ///< a datagram is available to w5x00_udp_rx_peek
+#define W5X00_UDP_EVENT_SENT        (0x02)  ///< a datagram was sent, there may be room for w5x00_udp_tx_reserve
+#define W5X00_UDP_EVENT_ERROR       (0x04)  ///< a datagram could not be sent (e.g. ARP for the destination failed)
+//!\}
+
+struct _w5x00_udp_t;
+
+// Called from the async_context with the w5x00 lock held, but not the SPI bus, so it may call back
+// into this API or into lwIP
+typedef void (*w5x00_udp_event_cb_t)(struct _w5x00_udp_t *udp, uint8_t events, void *arg);
+
+// UDP handled by the chip's own stack on one of the hardware sockets. Datagrams are built
+// directly in the socket's TX ring and read directly from its RX ring, lwIP isn't involved
+typedef struct _w5x00_udp_t {
+    w5x00_t *w5x00;
+    int8_t sn;
+    bool send_busy;         // a SEND is in progress
+    bool send_pending;      // a committed datagram is waiting for it to finish
+    uint16_t tx_reserved;   // size of the datagram being built
+    uint16_t tx_ptr;        // start of the datagram being built
+    uint16_t tx_end;        // end of the committed datagrams
+    uint16_t tx_wr;         // last value written to Sn_TX_WR
+    uint8_t dest_ip[4];     // destination last written to the chip
+    uint16_t dest_port;
+    uint8_t pending_ip[4];  // destination of the pending datagram
+    uint16_t pending_port;
+    uint32_t rx_errors;     // times the RX ring held a datagram longer than the data received, and was flushed
+    w5x00_udp_event_cb_t event_cb;
+    void *arg;
+} w5x00_udp_t;
+
+// A received datagram, still in the RX ring
+typedef struct _w5x00_udp_rx_view_t {
+    uint8_t ip[4];
+    uint16_t port;
+    uint16_t len;
+    uint16_t ptr;   // ring position of the payload
+} w5x00_udp_rx_view_t;
+
+// Claim a hardware socket and bind it for UDP on local_port
+int w5x00_udp_open(w5x00_t *self, w5x00_udp_t *udp, uint16_t local_port, w5x00_udp_event_cb_t event_cb, void *arg);
+void w5x00_udp_close(w5x00_udp_t *udp);
+
+// Reserve len bytes in the TX ring for the next datagram. Returns false if there's no room
+// yet, wait for W5X00_UDP_EVENT_SENT and try again
+bool w5x00_udp_tx_reserve(w5x00_udp_t *udp, uint16_t len);
+
+// Fill part of the reserved datagram, in any order
+void w5x00_udp_tx_write(w5x00_udp_t *udp, uint16_t offset, const void *buf, uint16_t len);
+
+// Send the reserved datagram with a single SEND
+int w5x00_udp_tx_commit(w5x00_udp_t *udp, const uint8_t ip[4], uint16_t port);
+
+// Get a view of the next received datagram. Returns false if there isn't one, or its header
+// claims more data than has been received (the ring is then flushed)
+bool w5x00_udp_rx_peek(w5x00_udp_t *udp, w5x00_udp_rx_view_t *view);
+
+// Read part of the payload of a datagram
+void w5x00_udp_rx_read(w5x00_udp_t *udp, const w5x00_udp_rx_view_t *view, uint16_t offset, void *buf, uint16_t len);
+
+// Free the ring space of a datagram, which must be the one returned by the last w5x00_udp_rx_peek
+void w5x00_udp_rx_release(w5x00_udp_t *udp, const w5x00_udp_rx_view_t *view);
+
+#endif
@@ -0,0 +1,150 @@
+#include "w5x00_capture.h"
+
+#if W5X00_CAPTURE && W5X00_LWIP
+
+#include "pico/time.h"
+#include "lwip/pbuf.h"
+
+typedef struct _w5x00_capture_slot_t {
+    uint64_t time_us;
+    uint16_t orig_len;
+    uint16_t cap_len;
+    uint8_t data[W5X00_CAPTURE_SNAPLEN];
+} w5x00_capture_slot_t;
+
+// Classic pcap headers, written in native byte order which readers detect from the magic
+typedef struct _w5x00_pcap_header_t {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+} w5x00_pcap_header_t;
+
+typedef struct _w5x00_pcap_record_t {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} w5x00_pcap_record_t;
+
+#define W5X00_PCAP_MAGIC        (0xa1b2c3d4)
+#define W5X00_PCAP_LINKTYPE_ETHERNET (1)
+
+w5x00_t *w5x00_capture_target;
+
+// Only touched with the lock held
+static struct {
+    uint8_t dirs;
+    uint16_t snaplen;
+    uint16_t ethertype;
+    uint32_t head;  // frames captured
+    uint32_t tail;  // frames written out or overwritten
+    uint32_t lost;
+    w5x00_capture_slot_t slots[W5X00_CAPTURE_SLOTS];
+} w5x00_capture;
+
+void w5x00_capture_frame(uint8_t dir, const struct pbuf *p) {
+    W5X00_THREAD_LOCK_CHECK;
+    if (!(w5x00_capture.dirs & dir)) {
+        return;
+    }
+    if (w5x00_capture.ethertype) {
+        if (p->tot_len < 14 ||
+                ((pbuf_get_at(p, 12) << 8) | pbuf_get_at(p, 13)) != w5x00_capture.ethertype) {
+            return;
+        }
+    }
+    if (w5x00_capture.head - w5x00_capture.tail == W5X00_CAPTURE_SLOTS) {
+        w5x00_capture.tail++;
+        w5x00_capture.lost++;
+    }
+    w5x00_capture_slot_t *slot = &w5x00_capture.slots[w5x00_capture.head++ % W5X00_CAPTURE_SLOTS];
+    slot->time_us = time_us_64();
+    slot->orig_len = p->tot_len;
+    slot->cap_len = pbuf_copy_partial(p, slot->data, MIN(p->tot_len, w5x00_capture.snaplen), 0);
+}
+
+int w5x00_capture_start(w5x00_t *self, uint8_t dirs, uint16_t snaplen, uint16_t ethertype) {
+    if (!(dirs & (W5X00_CAPTURE_RX | W5X00_CAPTURE_TX))) {
+        return -W5X00_EINVAL;
+    }
+    W5X00_THREAD_ENTER;
+    w5x00_capture.dirs = dirs;
+    w5x00_capture.snaplen = MIN(snaplen, W5X00_CAPTURE_SNAPLEN);
+    w5x00_capture.ethertype = ethertype;
+    w5x00_capture_target = self;
+    W5X00_THREAD_EXIT;
+    return 0;
+}
+
+void w5x00_capture_stop(void) {
+    W5X00_THREAD_ENTER;
+    w5x00_capture_target = NULL;
+    W5X00_THREAD_EXIT;
+}
+
+uint w5x00_capture_write_pcap(w5x00_capture_write_fn_t fn, void *arg) {
+    W5X00_THREAD_ENTER;
+    uint16_t snaplen = w5x00_capture.snaplen;
+    W5X00_THREAD_EXIT;
+    const w5x00_pcap_header_t header = {
+        .magic = W5X00_PCAP_MAGIC,
+        .version_major = 2,
+        .version_minor = 4,
+        // As given to w5x00_capture_start, or the most there could be if it hasn't been called
+        .snaplen = snaplen ? snaplen : W5X00_CAPTURE_SNAPLEN,
+        .network = W5X00_PCAP_LINKTYPE_ETHERNET,
+    };
+    fn(&header, sizeof(header), arg);
+
+    // Take one frame at a time, so the lock isn't held while fn runs
+    w5x00_capture_slot_t slot;
+    uint frames = 0;
+    for (;;) {
+        W5X00_THREAD_ENTER;
+        bool empty = w5x00_capture.tail == w5x00_capture.head;
+        if (!empty) {
+            slot = w5x00_capture.slots[w5x00_capture.tail++ % W5X00_CAPTURE_SLOTS];
+        }
+        W5X00_THREAD_EXIT;
+        if (empty) {
+            break;
+        }
+        const w5x00_pcap_record_t record = {
+            .ts_sec = (uint32_t)(slot.time_us / 1000000),
+            .ts_usec = (uint32_t)(slot.time_us % 1000000),
+            .incl_len = slot.cap_len,
+            .orig_len = slot.orig_len,
+        };
+        fn(&record, sizeof(record), arg);
+        fn(slot.data, slot.cap_len, arg);
+        frames++;
+    }
+    return frames;
+}
+
+uint32_t w5x00_capture_lost(void) {
+    return w5x00_capture.lost;
+}
+
+#else
+
+int w5x00_capture_start(__unused w5x00_t *self, __unused uint8_t dirs, __unused uint16_t snaplen, __unused uint16_t ethertype) {
+    return -W5X00_EPERM;
+}
+
+void w5x00_capture_stop(void) {
+}
+
+uint w5x00_capture_write_pcap(__unused w5x00_capture_write_fn_t fn, __unused void *arg) {
+    return 0;
+}
+
+uint32_t w5x00_capture_lost(void) {
+    return 0;
+}
+
+#endif
@@ -10,6 +10,9 @@
 #include "pico/unique_id.h"
 #include "w5x00.h"
 #include "w5x00_spi.h"
+#include "w5x00_trace.h"
+#include "w5x00_capture.h"
+#include "w5x00_pipe.h"
 #include "pico/w5x00_driver.h"
 
 #include "wizchip_conf.h"
@@ -19,153 +22,397 @@
 #define W5X00_GPIO_IRQ_HANDLER_PRIORITY 0x40
 #endif
 
-#ifndef W5X00_SLEEP_CHECK_MS
-#define W5X00_SLEEP_CHECK_MS 50
+#ifndef W5X00_DMA_IRQ_HANDLER_PRIORITY
+#define W5X00_DMA_IRQ_HANDLER_PRIORITY PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY
 #endif
 
+#if _WIZCHIP_ == W5100S
+// Start of the TX and RX buffer memory, socket buffers are allocated contiguously from here
+#define W5X00_TXBUF_BASE 0x4000
+#define W5X00_RXBUF_BASE 0x6000
+#else
+#define W5X00_TXBUF_BASE 0
+#define W5X00_RXBUF_BASE 0
+#endif
+
+// w5x00_t.phy_status bits, the same for both chips
+#define W5X00_PHY_LINK          (0x01)
+#define W5X00_PHY_100M          (0x02)
+#define W5X00_PHY_FULL_DUPLEX   (0x04)
+#define W5X00_PHY_UNKNOWN       (0xff)
+
+static_assert(W5X00_HW_SOCKETS < _WIZCHIP_SOCK_NUM_, "too many hardware sockets");
+static_assert(W5X00_MACRAW_BUF_KB + W5X00_HW_SOCKETS * W5X00_HW_SOCKET_BUF_KB <= W5X00_CHIP_BUF_KB, "socket buffers exceed chip memory");
+
 static async_context_t *w5x00_async_context;
 
-static void w5x00_sleep_timeout_reached(async_context_t *context, async_at_time_worker_t *worker);
-static void w5x00_do_poll(async_context_t *context, async_when_pending_worker_t *worker);
+// Lock hold time, measured from the outermost w5x00_thread_enter (or async_context worker) to
+// the matching exit. Only touched with the lock held
+static uint w5x00_lock_depth;
+static uint32_t w5x00_lock_start_us;
+static uint64_t w5x00_lock_us;
+static uint32_t w5x00_lock_max_us;
+static uint32_t w5x00_lock_acquires;
+
+static inline void w5x00_lock_taken(void) {
+    if (w5x00_lock_depth++ == 0) {
+        w5x00_lock_start_us = time_us_32();
+        w5x00_lock_acquires++;
+    }
+}
 
-static async_at_time_worker_t sleep_timeout_worker = {
-        .do_work = w5x00_sleep_timeout_reached
-};
+static inline void w5x00_lock_releasing(void) {
+    if (--w5x00_lock_depth == 0) {
+        uint32_t held_us = time_us_32() - w5x00_lock_start_us;
+        w5x00_lock_us += held_us;
+        if (held_us > w5x00_lock_max_us) {
+            w5x00_lock_max_us = held_us;
+        }
+    }
+}
 
-static async_when_pending_worker_t w5x00_poll_worker = {
-        .do_work = w5x00_do_poll
-};
+// SPI bus lock, see w5x00_bus_enter. The depth and hold time are only touched with the bus held
+#if W5X00_PIPE
+#include "pico/mutex.h"
+
+// Serialises the cores' access to the chip, core 1 holds it for each pass over the chip
+auto_init_mutex(w5x00_bus_mutex);
+static volatile int8_t w5x00_bus_owner = -1;    // core holding the bus
+#endif
+static uint w5x00_bus_depth;
+static uint32_t w5x00_bus_start_us;
+static uint64_t w5x00_bus_us;
+static uint32_t w5x00_bus_max_us;
+static uint32_t w5x00_bus_acquires;
+static uint32_t w5x00_bus_nested;
+
+// Every chip that has been added with w5x00_driver_init_instance, indexed by w5x00_t.idx
+static w5x00_t *w5x00_instances[W5X00_MAX_INSTANCES];
+static uint w5x00_instance_count;
+
+#if W5X00_PIPE
+static w5x00_pipe_slot_t w5x00_pipe_rx_slots[W5X00_PIPE_RX_SLOTS];
+static w5x00_pipe_slot_t w5x00_pipe_tx_slots[W5X00_PIPE_TX_SLOTS];
+// Core 1 produces the RX ring and core 0 the TX ring
+static w5x00_pipe_ring_t w5x00_pipe_rx = { .len = W5X00_PIPE_RX_SLOTS, .slots = w5x00_pipe_rx_slots };
+static w5x00_pipe_ring_t w5x00_pipe_tx = { .len = W5X00_PIPE_TX_SLOTS, .slots = w5x00_pipe_tx_slots };
+
+static volatile bool w5x00_pipe_running;    // w5x00_pipe_core1_task has started
+static volatile bool w5x00_pipe_up;         // the chip is up, core 1 leaves it alone until then
+static volatile uint32_t w5x00_pipe_irq_us; // when INTn last fired
+static volatile bool w5x00_pipe_sn_pending; // hardware socket interrupts for core 0 to handle
+static volatile bool w5x00_pipe_link_lost;  // core 1 saw the link fail, core 0 takes the netif down
+static uint32_t w5x00_pipe_tx_reclaimed;     // TX slots core 0 has dropped its pbuf reference for
+
+static void w5x00_pipe_poll_func(w5x00_t *self);
+static int w5x00_pipe_send(w5x00_t *self, size_t len, const void *buf, bool is_pbuf);
+static void w5x00_pipe_tx_reclaim(uint32_t upto);
+#endif
 
-static void w5x00_set_irq_enabled(bool enabled) {
-    gpio_set_irq_enabled(W5X00_GPIO_INTN_PIN, GPIO_IRQ_LEVEL_LOW, enabled);
+static void w5x00_coalesce_timeout_reached(async_context_t *context, async_at_time_worker_t *worker);
+static void w5x00_napi_poll_due(async_context_t *context, async_at_time_worker_t *worker);
+static void w5x00_link_timeout_reached(async_context_t *context, async_at_time_worker_t *worker);
+static void w5x00_link_update(w5x00_t *self);
+static void w5x00_do_poll(async_context_t *context, async_when_pending_worker_t *worker);
+
+static void w5x00_set_irq_enabled(w5x00_t *self, bool enabled) {
+    gpio_set_irq_enabled(self->hw.intn_pin, GPIO_IRQ_LEVEL_LOW, enabled);
 }
 
 // GPIO interrupt handler to tell us there's w5x00 has work to do
-static void w5x00_gpio_irq_handler(void)
+static void w5x00_gpio_irq_handler(w5x00_t *self)
 {
-    uint32_t events = gpio_get_irq_event_mask(W5X00_GPIO_INTN_PIN);
+    uint32_t events = gpio_get_irq_event_mask(self->hw.intn_pin);
     if (events & GPIO_IRQ_LEVEL_LOW) {
+        W5X00_TRACE_EVENT(W5X00_TRACE_IRQ, self->idx);
         // As we use a high level interrupt, it will go off forever until it's serviced
         // So disable the interrupt until this is done. It's re-enabled again by W5X00_POST_POLL_HOOK
         // which is called at the end of w5x00_poll_func
-        w5x00_set_irq_enabled(false);
-        async_context_set_work_pending(w5x00_async_context, &w5x00_poll_worker);
+        w5x00_set_irq_enabled(self, false);
+        self->rx_start_us = time_us_32();
+        self->irq_pending = true;
+        self->stats.irqs++;
+        async_context_set_work_pending(w5x00_async_context, &self->poll_worker);
     }
 }
 
-uint32_t w5x00_irq_init(__unused void *param) {
+// Raw GPIO handlers can't be passed a parameter, so each instance gets its own
+#define W5X00_GPIO_IRQ_HANDLER(n) \
+static void w5x00_gpio_irq_handler_##n(void) { \
+    w5x00_gpio_irq_handler(w5x00_instances[n]); \
+}
+W5X00_GPIO_IRQ_HANDLER(0)
+W5X00_GPIO_IRQ_HANDLER(1)
+W5X00_GPIO_IRQ_HANDLER(2)
+W5X00_GPIO_IRQ_HANDLER(3)
+
+static void (*const w5x00_gpio_irq_handlers[])(void) = {
+    w5x00_gpio_irq_handler_0,
+    w5x00_gpio_irq_handler_1,
+    w5x00_gpio_irq_handler_2,
+    w5x00_gpio_irq_handler_3,
+};
+static_assert(W5X00_MAX_INSTANCES <= count_of(w5x00_gpio_irq_handlers), "too many instances");
+
+// DMA interrupt handler to tell us an SPI burst has finished
+static void w5x00_dma_irq_handler(void)
+{
+    for (uint i = 0; i < W5X00_MAX_INSTANCES; i++) {
+        w5x00_t *self = w5x00_instances[i];
+        if (self && self->dma_rx >= 0 && dma_irqn_get_channel_status(W5X00_DMA_IRQ_NUM, self->dma_rx)) {
+            dma_irqn_acknowledge_channel(W5X00_DMA_IRQ_NUM, self->dma_rx);
+            // Wake up whoever is waiting in w5x00_spi_wait_burst
+            sem_release(&self->dma_done);
+        }
+    }
+}
+
+uint32_t w5x00_irq_init(void *param) {
 #ifndef NDEBUG
     assert(get_core_num() == async_context_core_num(w5x00_async_context));
 #endif
-    gpio_add_raw_irq_handler_with_order_priority(W5X00_GPIO_INTN_PIN, w5x00_gpio_irq_handler, W5X00_GPIO_IRQ_HANDLER_PRIORITY);
-    w5x00_set_irq_enabled(true);
+    #if W5X00_PIPE
+    // Core 1 takes the interrupts, see w5x00_pipe_core1_task
+    (void)param;
+    return 0;
+    #endif
+    w5x00_t *self = param;
+    gpio_add_raw_irq_handler_with_order_priority(self->hw.intn_pin, w5x00_gpio_irq_handlers[self->idx], W5X00_GPIO_IRQ_HANDLER_PRIORITY);
+    w5x00_set_irq_enabled(self, true);
     irq_set_enabled(IO_IRQ_BANK0, true);
+    if (w5x00_instance_count == 1) {
+        irq_add_shared_handler(DMA_IRQ_0 + W5X00_DMA_IRQ_NUM, w5x00_dma_irq_handler, W5X00_DMA_IRQ_HANDLER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_0 + W5X00_DMA_IRQ_NUM, true);
+    }
     return 0;
 }
 
-uint32_t w5x00_irq_deinit(__unused void *param) {
+uint32_t w5x00_irq_deinit(void *param) {
 #ifndef NDEBUG
     assert(get_core_num() == async_context_core_num(w5x00_async_context));
 #endif
-    gpio_remove_raw_irq_handler(W5X00_GPIO_INTN_PIN, w5x00_gpio_irq_handler);
-    w5x00_set_irq_enabled(false);
+    #if W5X00_PIPE
+    (void)param;
+    return 0;
+    #endif
+    w5x00_t *self = param;
+    gpio_remove_raw_irq_handler(self->hw.intn_pin, w5x00_gpio_irq_handlers[self->idx]);
+    w5x00_set_irq_enabled(self, false);
+    if (w5x00_instance_count == 1) {
+        irq_remove_handler(DMA_IRQ_0 + W5X00_DMA_IRQ_NUM, w5x00_dma_irq_handler);
+    }
     return 0;
 }
 
-void w5x00_post_poll_hook(void) {
+void w5x00_post_poll_hook(w5x00_t *self) {
 #ifndef NDEBUG
     assert(get_core_num() == async_context_core_num(w5x00_async_context));
 #endif
-    w5x00_set_irq_enabled(true);
+    // Left disabled while coalescing or polling, w5x00_poll_func sees INTn itself
+    if (!self->coalescing && !self->napi_polling) {
+        w5x00_set_irq_enabled(self, true);
+    }
 }
 
-void w5x00_schedule_internal_poll_dispatch(__unused void (*func)(void)) {
-    assert(func == w5x00_poll);
-    async_context_set_work_pending(w5x00_async_context, &w5x00_poll_worker);
+void w5x00_schedule_internal_poll_dispatch(w5x00_t *self) {
+    async_context_set_work_pending(w5x00_async_context, &self->poll_worker);
 }
 
-static void w5x00_do_poll(async_context_t *context, __unused async_when_pending_worker_t *worker) {
+static void w5x00_do_poll(async_context_t *context, async_when_pending_worker_t *worker) {
 #ifndef NDEBUG
     assert(get_core_num() == async_context_core_num(w5x00_async_context));
 #endif
-    if (w5x00_poll) {
-        if (w5x00_sleep > 0) {
-            w5x00_sleep--;
-        }
-        w5x00_poll();
-        if (w5x00_sleep) {
-            async_context_add_at_time_worker_in_ms(context, &sleep_timeout_worker, W5X00_SLEEP_CHECK_MS);
-        } else {
-            async_context_remove_at_time_worker(context, &sleep_timeout_worker);
+    w5x00_t *self = worker->user_data;
+    w5x00_lock_taken();
+    W5X00_TRACE_EVENT(W5X00_TRACE_POLL_BEGIN, self->idx);
+    if (self->poll) {
+        if (self->irq_pending) {
+            self->irq_pending = false;
+            if (self->coalescing) {
+                // Already waiting for the window to close
+                W5X00_TRACE_EVENT(W5X00_TRACE_POLL_END, self->idx);
+                w5x00_lock_releasing();
+                return;
+            }
+            uint32_t window_us = self->coalesce_window_us;
+            if (window_us && !self->rx_more) {
+                // Let more frames arrive, w5x00_coalesce_timeout_reached polls when the window closes
+                self->coalescing = true;
+                async_context_add_at_time_worker_at(context, &self->coalesce_worker, make_timeout_time_us(window_us));
+                W5X00_TRACE_EVENT(W5X00_TRACE_POLL_END, self->idx);
+                w5x00_lock_releasing();
+                return;
+            }
         }
+        self->poll(self);
     }
+    W5X00_TRACE_EVENT(W5X00_TRACE_POLL_END, self->idx);
+    w5x00_lock_releasing();
 }
 
-static void w5x00_sleep_timeout_reached(async_context_t *context, __unused async_at_time_worker_t *worker) {
+static void w5x00_coalesce_timeout_reached(async_context_t *context, async_at_time_worker_t *worker) {
     assert(context == w5x00_async_context);
-    assert(worker == &sleep_timeout_worker);
-    async_context_set_work_pending(context, &w5x00_poll_worker);
+    w5x00_t *self = worker->user_data;
+    self->coalescing = false;
+    async_context_set_work_pending(context, &self->poll_worker);
+}
+
+static void w5x00_napi_poll_due(async_context_t *context, async_at_time_worker_t *worker) {
+    assert(context == w5x00_async_context);
+    w5x00_t *self = worker->user_data;
+    async_context_set_work_pending(context, &self->poll_worker);
+}
+
+static void w5x00_link_timeout_reached(async_context_t *context, async_at_time_worker_t *worker) {
+    assert(context == w5x00_async_context);
+    w5x00_t *self = worker->user_data;
+    if (self->poll) {
+        w5x00_lock_taken();
+        w5x00_t *prev = w5x00_activate(self);
+        w5x00_link_update(self);
+        w5x00_activate(prev);
+        w5x00_lock_releasing();
+    }
+    async_context_add_at_time_worker_in_ms(context, &self->link_worker, W5X00_LINK_POLL_MS);
 }
 
 bool w5x00_driver_init(async_context_t *context) {
-    gpio_init(W5X00_GPIO_INTN_PIN);
-    w5x00_hal_pin_config(W5X00_GPIO_INTN_PIN, W5X00_HAL_PIN_MODE_INPUT, W5X00_HAL_PIN_PULL_UP, 0);
+    const w5x00_hw_config_t config = W5X00_HW_CONFIG_DEFAULT;
+    return w5x00_driver_init_instance(context, &w5x00_state, &config);
+}
+
+bool w5x00_driver_init_instance(async_context_t *context, w5x00_t *self, const w5x00_hw_config_t *config) {
+    // The ioLibrary is shared, so all the chips must be serialised by the same lock
+    if (w5x00_async_context && context != w5x00_async_context) {
+        return false;
+    }
+    uint idx;
+    for (idx = 0; idx < W5X00_MAX_INSTANCES && w5x00_instances[idx]; idx++);
+    if (idx == W5X00_MAX_INSTANCES) {
+        return false;
+    }
+
+    memset(self, 0, sizeof(*self));
+    self->hw = *config;
+    self->idx = (uint8_t)idx;
+
+    gpio_init(self->hw.intn_pin);
+    w5x00_hal_pin_config(self->hw.intn_pin, W5X00_HAL_PIN_MODE_INPUT, W5X00_HAL_PIN_PULL_UP, 0);
     // bi_decl(bi_1pin_with_name(W5X00_GPIO_INTN_PIN, "W5x00 INTERRUPT"));
-    gpio_init(W5X00_GPIO_RSTN_PIN);
-    w5x00_hal_pin_config(W5X00_GPIO_RSTN_PIN, W5X00_HAL_PIN_MODE_OUTPUT, W5X00_HAL_PIN_PULL_NONE, 0);
-    w5x00_hal_pin_low(W5X00_GPIO_RSTN_PIN); // Hold Wiznet in reset
+    gpio_init(self->hw.rstn_pin);
+    w5x00_hal_pin_config(self->hw.rstn_pin, W5X00_HAL_PIN_MODE_OUTPUT, W5X00_HAL_PIN_PULL_NONE, 0);
+    w5x00_hal_pin_low(self->hw.rstn_pin); // Hold Wiznet in reset
     // bi_decl(bi_1pin_with_name(W5X00_GPIO_RSTN_PIN, "W5x00 RESET"));
 
-    w5x00_state.itf_state = 0;
-    w5x00_state.ethernet_link_state = W5X00_LINK_DOWN;
-    w5x00_state.dma_tx = -1;
-    w5x00_state.dma_rx = -1;
+    self->itf_state = 0;
+    self->ethernet_link_state = W5X00_LINK_DOWN;
+    self->dma_tx = -1;
+    self->dma_rx = -1;
+    self->rx_budget_frames = W5X00_RX_POLL_MAX_FRAMES;
+    self->rx_budget_bytes = W5X00_RX_POLL_MAX_BYTES;
+    self->rx_more = false;
+    self->coalesce_frames = W5X00_IRQ_COALESCE_FRAMES;
+    self->coalesce_us = self->coalesce_window_us = W5X00_IRQ_COALESCE_US;
+    self->wakeup_frames = 0;
+    self->napi_polling = false;
+    self->napi_enter_frames = W5X00_NAPI_ENTER_FRAMES;
+    self->napi_exit_polls = W5X00_NAPI_EXIT_EMPTY_POLLS;
+    self->bcast_cost_us = W5X00_BCAST_RATE ? 1000000 / W5X00_BCAST_RATE : 0;
+    self->bcast_credit_max_us = self->bcast_credit_us = self->bcast_cost_us * W5X00_BCAST_BURST;
+    self->napi_empty_polls = 0;
+    self->irq_pending = false;
+    self->coalescing = false;
+    self->sn_size[0] = self->sn_size[_WIZCHIP_SOCK_NUM_] = W5X00_MACRAW_BUF_KB;
+    for (int sn = 1; sn <= W5X00_HW_SOCKETS; sn++) {
+        self->sn_size[sn] = self->sn_size[_WIZCHIP_SOCK_NUM_ + sn] = W5X00_HW_SOCKET_BUF_KB;
+    }
+    self->sn_in_use = 0;
 
-    w5x00_poll = NULL;
-    w5x00_state.initted = true;
+    self->poll_worker.do_work = w5x00_do_poll;
+    self->poll_worker.user_data = self;
+    self->coalesce_worker.do_work = w5x00_coalesce_timeout_reached;
+    self->coalesce_worker.user_data = self;
+    self->napi_worker.do_work = w5x00_napi_poll_due;
+    self->napi_worker.user_data = self;
+    self->link_worker.do_work = w5x00_link_timeout_reached;
+    self->link_worker.user_data = self;
+    self->phy_status = W5X00_PHY_UNKNOWN;
+
+    self->poll = NULL;
+    self->initted = true;
 
     w5x00_async_context = context;
+    w5x00_instances[idx] = self;
+    w5x00_instance_count++;
     // we need the IRQ to be on the same core as the context, because we need to be able to enable/disable the IRQ
     // from there later
-    async_context_execute_sync(context, w5x00_irq_init, NULL);
-    async_context_add_when_pending_worker(context, &w5x00_poll_worker);
+    async_context_execute_sync(context, w5x00_irq_init, self);
+    async_context_add_when_pending_worker(context, &self->poll_worker);
+    async_context_add_at_time_worker_in_ms(context, &self->link_worker, W5X00_LINK_POLL_MS);
     return true;
 }
 
 void w5x00_driver_deinit(async_context_t *context) {
+    w5x00_driver_deinit_instance(context, &w5x00_state);
+}
+
+void w5x00_driver_deinit_instance(async_context_t *context, w5x00_t *self) {
     assert(context == w5x00_async_context);
-    async_context_remove_at_time_worker(context, &sleep_timeout_worker);
-    async_context_remove_when_pending_worker(context, &w5x00_poll_worker);
+    assert(w5x00_instances[self->idx] == self);
+    async_context_remove_at_time_worker(context, &self->coalesce_worker);
+    async_context_remove_at_time_worker(context, &self->napi_worker);
+    async_context_remove_at_time_worker(context, &self->link_worker);
+    self->coalescing = false;
+    async_context_remove_when_pending_worker(context, &self->poll_worker);
     // the IRQ IS on the same core as the context, so must be de-initialized there
-    async_context_execute_sync(context, w5x00_irq_deinit, NULL);
+    async_context_execute_sync(context, w5x00_irq_deinit, self);
+    #if W5X00_PIPE
+    // Wait for core 1 to finish its pass over the chip, it doesn't start another
+    w5x00_bus_enter();
+    w5x00_pipe_up = false;
+    w5x00_bus_exit();
+    __sev();
+    // Frames core 1 won't now send
+    w5x00_pipe_tx_reclaim(w5x00_pipe_tx.head);
+    #endif
     // w5x00_deinit(&w5x00_state);  // LWK: cyw43-driver, replace with ??
-    w5x00_cb_tcpip_deinit(&w5x00_state);
-    w5x00_spi_deinit(&w5x00_state);
-
-    w5x00_state.itf_state = 0;
-    w5x00_state.ethernet_link_state = W5X00_LINK_DOWN;
-    w5x00_poll = NULL;
-    w5x00_state.initted = false;
+    w5x00_cb_tcpip_deinit(self);
+    w5x00_spi_deinit(self);
 
-    w5x00_async_context = NULL;
+    self->itf_state = 0;
+    self->ethernet_link_state = W5X00_LINK_DOWN;
+    self->joined = false;
+    self->poll = NULL;
+    self->initted = false;
+
+    w5x00_instances[self->idx] = NULL;
+    if (--w5x00_instance_count == 0) {
+        w5x00_async_context = NULL;
+    }
+    if (w5x00_active == self) {
+        w5x00_active = &w5x00_state;
+    }
 }
 
 // Generate a mac address if one is not set in otp
-void __attribute__((weak)) w5x00_hal_generate_laa_mac(__unused int idx, uint8_t buf[6]) {
+void __attribute__((weak)) w5x00_hal_generate_laa_mac(int idx, uint8_t buf[6]) {
     W5X00_DEBUG("W5X00: No mac set. Generating mac from board id\n");
     pico_unique_board_id_t board_id;
     pico_get_unique_board_id(&board_id);
     memcpy(buf, &board_id.id[2], 6);
+    // each chip on the board needs its own address
+    buf[5] ^= (uint8_t)(idx - W5X00_HAL_MAC_ETH0);
     buf[0] &= (uint8_t)~0x1; // unicast
     buf[0] |= 0x2; // locally administered
 }
 
 // Return mac address
-void w5x00_hal_get_mac(__unused int idx, uint8_t buf[6]) {
+void w5x00_hal_get_mac(int idx, uint8_t buf[6]) {
     // The mac should come from w5x00 otp.
     // This is loaded into the state after the driver is initialised
     // w5x00_hal_generate_laa_mac is called by the driver to generate a mac if otp is not set
-    memcpy(buf, w5x00_state.mac, 6);
+    w5x00_t *self = w5x00_instances[idx - W5X00_HAL_MAC_ETH0];
+    memcpy(buf, self->mac, 6);
 }
 
 // Prevent background processing in pensv and access by the other core
@@ -173,12 +420,51 @@ void w5x00_hal_get_mac(__unused int idx, uint8_t buf[6]) {
 // They can be called recursively
 void w5x00_thread_enter(void) {
     async_context_acquire_lock_blocking(w5x00_async_context);
+    w5x00_lock_taken();
+    W5X00_TRACE_EVENT(W5X00_TRACE_LOCK_ACQUIRE, w5x00_lock_depth);
 }
 
 void w5x00_thread_exit(void) {
+    W5X00_TRACE_EVENT(W5X00_TRACE_LOCK_RELEASE, w5x00_lock_depth);
+    w5x00_lock_releasing();
     async_context_release_lock(w5x00_async_context);
 }
 
+// The ioLibrary takes the bus around every register access, so the driver takes it once around each whole
+// operation and the ioLibrary's acquisitions only count the depth. Without W5X00_PIPE everything that touches
+// the chip holds the async_context lock, so there's no one to exclude and no lock to take
+void w5x00_bus_enter(void) {
+    #if W5X00_PIPE
+    int8_t core = (int8_t)get_core_num();
+    if (w5x00_bus_owner != core) {
+        mutex_enter_blocking(&w5x00_bus_mutex);
+        w5x00_bus_owner = core;
+    }
+    #else
+    W5X00_THREAD_LOCK_CHECK;
+    #endif
+    if (w5x00_bus_depth++ == 0) {
+        w5x00_bus_start_us = time_us_32();
+        w5x00_bus_acquires++;
+    } else {
+        w5x00_bus_nested++;
+    }
+}
+
+void w5x00_bus_exit(void) {
+    if (--w5x00_bus_depth == 0) {
+        uint32_t held_us = time_us_32() - w5x00_bus_start_us;
+        w5x00_bus_us += held_us;
+        if (held_us > w5x00_bus_max_us) {
+            w5x00_bus_max_us = held_us;
+        }
+        #if W5X00_PIPE
+        w5x00_bus_owner = -1;
+        mutex_exit(&w5x00_bus_mutex);
+        #endif
+    }
+}
+
 #ifndef NDEBUG
 void w5x00_thread_lock_check(void) {
     async_context_lock_check(w5x00_async_context);
@@ -217,20 +503,101 @@ void __attribute__((weak)) w5x00_cb_tcpip_set_link_up(w5x00_t *self) {
 void __attribute__((weak)) w5x00_cb_tcpip_set_link_down(w5x00_t *self) {
     no_lwip_fail();
 }
-void __attribute__((weak)) w5x00_cb_process_ethernet(void *cb_data, size_t len, const uint8_t *buf) {
+void __attribute__((weak)) w5x00_cb_process_ethernet(void *cb_data, size_t len) {
     no_lwip_fail();
 }
+void __attribute__((weak)) w5x00_cb_rx_batch_done(w5x00_t *self) {
+}
 #endif
 
 w5x00_t w5x00_state;
-void (*w5x00_poll)(void);
-uint32_t w5x00_sleep;
+w5x00_t *w5x00_active = &w5x00_state;
 
 #ifndef W5X00_POST_POLL_HOOK
-#define W5X00_POST_POLL_HOOK
+#define W5X00_POST_POLL_HOOK(self)
 #endif
 
-static void w5x00_poll_func(void);
+// With W5X00_PIPE core 0 runs w5x00_pipe_poll_func instead
+static __unused void w5x00_poll_func(w5x00_t *self);
+static uint w5x00_recv_ethernet_batch(w5x00_t *self, uint max_frames, uint32_t max_bytes, uint32_t *bytes);
+static void w5x00_send_complete(w5x00_t *self, uint8_t ir);
+static void w5x00_rx_read_head(w5x00_t *self);
+
+static void w5x00_init_sn_buf(w5x00_t *self, const uint8_t *sn_size) {
+    uint16_t tx_base = W5X00_TXBUF_BASE;
+    uint16_t rx_base = W5X00_RXBUF_BASE;
+    for (int sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+        w5x00_sn_buf_t *sb = &self->sn_buf[sn];
+        sb->tx_base = tx_base;
+        sb->tx_size = (uint16_t)(sn_size[sn] * 1024);
+        sb->rx_base = rx_base;
+        sb->rx_size = (uint16_t)(sn_size[_WIZCHIP_SOCK_NUM_ + sn] * 1024);
+        tx_base += sb->tx_size;
+        rx_base += sb->rx_size;
+    }
+}
+
+#if W5X00_SPI_CALIBRATE
+// Write test patterns to the start of the socket 0 TX buffer and check they read back
+static bool w5x00_spi_test_pattern(void) {
+    uint8_t pattern[64];
+    uint8_t readback[sizeof(pattern)];
+    #if _WIZCHIP_ == W5500
+    const uint32_t addr = WIZCHIP_TXBUF_BLOCK(0) << 3;
+    #else
+    const uint32_t addr = W5X00_TXBUF_BASE;
+    #endif
+    for (uint round = 0; round < W5X00_SPI_CALIBRATE_ROUNDS; round++) {
+        for (uint i = 0; i < sizeof(pattern); i++) {
+            switch (round & 3) {
+                case 0: pattern[i] = (i & 1) ? 0x55 : 0xaa; break;
+                case 1: pattern[i] = (i & 1) ? 0x00 : 0xff; break;
+                case 2: pattern[i] = (uint8_t)(1u << (i & 7)); break;
+                default: pattern[i] = (uint8_t)(i * 37 + round); break;
+            }
+        }
+        WIZCHIP_WRITE_BUF(addr, pattern, sizeof(pattern));
+        WIZCHIP_READ_BUF(addr, readback, sizeof(readback));
+        if (memcmp(pattern, readback, sizeof(pattern)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Ramp up the SPI clock until the test pattern fails, then settle one step below the
+// fastest clock that passed. If W5X00_SPI_BAUD_MAX is reached first it's used as is.
+// The chip is reset afterwards, in case a corrupted address phase wrote somewhere it
+// shouldn't have
+static int w5x00_spi_calibrate(w5x00_t *self) {
+    uint good = w5x00_spi_get_baudrate(self);
+    if (!w5x00_spi_test_pattern()) {
+        return W5X00_FAIL_FAST_CHECK(-W5X00_EIO);
+    }
+    uint margin = good;
+    uint request = good;
+    bool failed = false;
+    while (request < W5X00_SPI_BAUD_MAX) {
+        request += request / 2;
+        uint actual = w5x00_spi_set_baudrate(self, request);
+        if (actual <= good) {
+            // same divider as before
+            continue;
+        }
+        if (!w5x00_spi_test_pattern()) {
+            failed = true;
+            break;
+        }
+        margin = good;
+        good = actual;
+    }
+    w5x00_spi_set_baudrate(self, failed ? margin : good);
+    ctlwizchip(CW_RESET_WIZCHIP, NULL);
+
+    W5X00_DEBUG("W5X00: spi clock %u Hz (passed up to %u Hz)\n", w5x00_spi_get_baudrate(self), good);
+    return 0;
+}
+#endif
 
 static int w5x00_ensure_up(w5x00_t *self) {
     W5X00_THREAD_LOCK_CHECK;
@@ -238,19 +605,25 @@ static int w5x00_ensure_up(w5x00_t *self) {
     #ifndef NDEBUG
     assert(w5x00_is_initialized(self)); // w5x00_init has not been called
     #endif
-    if (w5x00_poll != NULL) {
+    if (self->poll != NULL) {
         // w5x00_ll_bus_sleep(self, false); // LWK TODO ??
         return 0;
     }
+    #if W5X00_PIPE
+    if (!w5x00_pipe_running) {
+        // Nothing would service the chip
+        return -W5X00_EPERM;
+    }
+    #endif
 
     // Disable the netif if it was previously up
     w5x00_cb_tcpip_deinit(self);
     self->itf_state = 0;
 
     // Reset and power up the wiznet chip
-    w5x00_hal_pin_low(W5X00_GPIO_RSTN_PIN);
+    w5x00_hal_pin_low(self->hw.rstn_pin);
     w5x00_delay_ms(20);
-    w5x00_hal_pin_high(W5X00_GPIO_RSTN_PIN);
+    w5x00_hal_pin_high(self->hw.rstn_pin);
     w5x00_delay_ms(50);
 
     // Initialise the low-level driver
@@ -265,30 +638,48 @@ static int w5x00_ensure_up(w5x00_t *self) {
     // w5x00_spi_reset();
     // W5X00_EVENT_POLL_HOOK;
 
-    reg_wizchip_cris_cbfunc(w5x00_thread_enter, w5x00_thread_exit);
+    reg_wizchip_cris_cbfunc(w5x00_bus_enter, w5x00_bus_exit);
     reg_wizchip_cs_cbfunc(w5x00_cs_select, w5x00_cs_deselect);
     reg_wizchip_spi_cbfunc(w5x00_spi_read, w5x00_spi_write);
     reg_wizchip_spiburst_cbfunc(w5x00_spi_read_burst, w5x00_spi_write_burst);
 
+    #if W5X00_SPI_CALIBRATE
+    ret = w5x00_spi_calibrate(self);
+    if (ret != 0) {
+        return ret;
+    }
+    #endif
+
     // wiznet5k_init();
-    #if _WIZCHIP_ < W5200
-    uint8_t sn_size[8] = {8, 0, 0, 0, 8, 0, 0, 0}; // 8k buffers on W5100 and W5100S
-    #else
-    uint8_t sn_size[16] = {16, 0, 0, 0, 0, 0, 0, 0, 16, 0, 0, 0, 0, 0, 0, 0};
+    // By default all the buffer memory goes to the MACRAW socket, see w5x00_set_buffer_partition
+    ctlwizchip(CW_INIT_WIZCHIP, self->sn_size);
+    w5x00_init_sn_buf(self, self->sn_size);
+    self->tx_synced = false;
+    #if W5X00_RX_DRAIN
+    self->rx_drain_next_len = 0;
+    self->rx_drain_held = 0;
     #endif
-    ctlwizchip(CW_INIT_WIZCHIP, sn_size);
+    self->sn_in_use = 0;
+    self->phy_status = W5X00_PHY_UNKNOWN;
 
     wizchip_setinterruptmask(IK_SOCK_0);
-    setSn_IMR(0, Sn_IR_RECV);
+    setSn_IMR(0, Sn_IR_RECV | Sn_IR_SENDOK | Sn_IR_TIMEOUT);
     #if _WIZCHIP_ == W5100S
     // Enable interrupt pin
     setMR2(MR2_G_IEN);
     #endif
+    #if W5X00_INTLEVEL
+    #if _WIZCHIP_ == W5500
+    setINTLEVEL(W5X00_INTLEVEL);
+    #else
+    setINTPTMR(W5X00_INTLEVEL);
+    #endif
+    #endif
 
     uint8_t *mac = self->mac;
     getSHAR(mac);
     if ((mac[0] | mac[1] | mac[2] | mac[3] | mac[4] | mac[5]) == 0) {
-        w5x00_hal_generate_laa_mac(W5X00_HAL_MAC_ETH0, mac);
+        w5x00_hal_generate_laa_mac(W5X00_HAL_MAC_ETH0 + self->idx, mac);
         setSHAR(mac);
     }
 
@@ -298,46 +689,269 @@ static int w5x00_ensure_up(w5x00_t *self) {
         self->mac[0], self->mac[1], self->mac[2], self->mac[3], self->mac[4], self->mac[5]);
 
     // Enable async events from low-level driver
-    w5x00_sleep = W5X00_SLEEP_MAX;
-    w5x00_poll = w5x00_poll_func;
+    #if W5X00_PIPE
+    w5x00_pipe_tx_reclaim(w5x00_pipe_tx.head);
+    w5x00_pipe_rx.head = w5x00_pipe_rx.tail = 0;
+    w5x00_pipe_tx.head = w5x00_pipe_tx.tail = 0;
+    w5x00_pipe_tx_reclaimed = 0;
+    self->poll = w5x00_pipe_poll_func;
+    // Hand the chip to core 1
+    w5x00_pipe_up = true;
+    __sev();
+    #else
+    self->poll = w5x00_poll_func;
+    #endif
 
     // Kick things off
-    w5x00_schedule_internal_poll_dispatch(w5x00_poll_func);
+    w5x00_schedule_internal_poll_dispatch(self);
+
+    return ret;
+}
+
+// Returns a bit per socket with a pending interrupt
+static uint8_t w5x00_get_socket_interrupts(void) {
+    #if _WIZCHIP_ == W5500
+    return getSIR();
+    #else
+    // The socket interrupts are the low bits of IR
+    return getIR() & ((1u << _WIZCHIP_SOCK_NUM_) - 1);
+    #endif
+}
+
+static void w5x00_update_interrupt_mask(w5x00_t *self) {
+    wizchip_setinterruptmask((intr_kind)((uint32_t)(self->sn_in_use | 1) << 8));
+}
+
+int w5x00_set_buffer_partition(w5x00_t *self, const uint8_t *tx_kb, const uint8_t *rx_kb) {
+    w5x00_t *prev_active = W5X00_ENTER(self);
+    if (self->poll != NULL) {
+        W5X00_EXIT(prev_active);
+        return -W5X00_EPERM;
+    }
+    uint tx_total = 0, rx_total = 0;
+    for (int sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+        // sizes must be a power of 2
+        if ((tx_kb[sn] & (tx_kb[sn] - 1)) || (rx_kb[sn] & (rx_kb[sn] - 1))) {
+            W5X00_EXIT(prev_active);
+            return -W5X00_EINVAL;
+        }
+        tx_total += tx_kb[sn];
+        rx_total += rx_kb[sn];
+    }
+    if (!tx_kb[0] || !rx_kb[0] || tx_total > W5X00_CHIP_BUF_KB || rx_total > W5X00_CHIP_BUF_KB) {
+        W5X00_EXIT(prev_active);
+        return -W5X00_EINVAL;
+    }
+    memcpy(self->sn_size, tx_kb, _WIZCHIP_SOCK_NUM_);
+    memcpy(self->sn_size + _WIZCHIP_SOCK_NUM_, rx_kb, _WIZCHIP_SOCK_NUM_);
+    W5X00_EXIT(prev_active);
+    return 0;
+}
 
+int w5x00_socket_alloc(w5x00_t *self, w5x00_sn_handler_t handler, void *param) {
+    w5x00_t *prev_active = W5X00_ENTER(self);
+    // Not with the bus held, bringing the chip up may take lwIP down and reset the chip
+    int ret = w5x00_ensure_up(self);
+    if (ret) {
+        W5X00_EXIT(prev_active);
+        return ret;
+    }
+    w5x00_bus_enter();
+    ret = -W5X00_EPERM;
+    for (uint8_t sn = 1; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+        if (!(self->sn_in_use & (1u << sn)) && self->sn_buf[sn].tx_size && self->sn_buf[sn].rx_size) {
+            self->sn_in_use |= (uint8_t)(1u << sn);
+            self->sn_handler[sn].fn = handler;
+            self->sn_handler[sn].param = param;
+            w5x00_update_interrupt_mask(self);
+            ret = sn;
+            break;
+        }
+    }
+    w5x00_bus_exit();
+    W5X00_EXIT(prev_active);
     return ret;
 }
 
+void w5x00_socket_free(w5x00_t *self, uint8_t sn) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(self);
+    assert(sn > 0 && sn < _WIZCHIP_SOCK_NUM_);
+    if (self->sn_in_use & (1u << sn)) {
+        self->sn_in_use &= (uint8_t)~(1u << sn);
+        self->sn_handler[sn].fn = NULL;
+        self->sn_handler[sn].param = NULL;
+        w5x00_update_interrupt_mask(self);
+    }
+    W5X00_BUS_EXIT(prev_active);
+}
+
+static void w5x00_rx_latency_record(w5x00_t *self) {
+    uint32_t latency_us = time_us_32() - self->rx_start_us;
+    uint bucket = 0;
+    while (bucket < W5X00_RX_LATENCY_BUCKETS - 1 && latency_us >= (1u << bucket)) {
+        bucket++;
+    }
+    self->stats.rx_latency[bucket]++;
+}
+
+// The RX buffer is empty, record how many frames this wakeup handled and adapt the coalescing window
+static void w5x00_wakeup_done(w5x00_t *self) {
+    w5x00_wakeup_stats_t *stats = &self->stats.wakeup;
+    uint16_t frames = self->wakeup_frames;
+    self->wakeup_frames = 0;
+    stats->wakeups++;
+    stats->frames += frames;
+    stats->last = frames;
+    if (frames > stats->max) {
+        stats->max = frames;
+    }
+    // Shorten the window when frames arrive faster than the target batch, so the RX buffer can't fill
+    if (frames > self->coalesce_frames) {
+        self->coalesce_window_us = self->coalesce_us * self->coalesce_frames / frames;
+    } else {
+        self->coalesce_window_us = self->coalesce_us;
+    }
+}
+
+// Read and clear the interrupts of the hardware sockets in sir into sn_ir. The bus must be held
+static void w5x00_sn_interrupts(uint8_t sir, uint8_t *sn_ir) {
+    for (uint8_t sn = 1; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+        sn_ir[sn] = 0;
+        if (sir & (1u << sn)) {
+            sn_ir[sn] = getSn_IR(sn);
+            setSn_IR(sn, sn_ir[sn]);
+        }
+    }
+}
+
+// Pass the interrupts read by w5x00_sn_interrupts to the socket handlers. Not with the bus held,
+// the handlers call back into the application
+static void w5x00_sn_dispatch(w5x00_t *self, const uint8_t *sn_ir) {
+    for (uint8_t sn = 1; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+        if (sn_ir[sn] && self->sn_handler[sn].fn) {
+            self->sn_handler[sn].fn(self, sn, sn_ir[sn], self->sn_handler[sn].param);
+        }
+    }
+}
+
 // This function must always be executed at the level where W5X00_THREAD_ENTER is effectively active
-static void w5x00_poll_func(void) {
+static void w5x00_poll_func(w5x00_t *self) {
     W5X00_THREAD_LOCK_CHECK;
 
-    if (w5x00_poll == NULL) {
+    if (self->poll == NULL) {
         // Poll scheduled during deinit, just ignore it
         return;
     }
 
-    w5x00_t *self = &w5x00_state;
-
-    if (w5x00_hal_pin_read(W5X00_GPIO_INTN_PIN) == 0) {
-        if ((self->netif.flags & (NETIF_FLAG_UP | NETIF_FLAG_LINK_UP)) == (NETIF_FLAG_UP | NETIF_FLAG_LINK_UP)) {
-            uint16_t len;
-            while ((len = wiznet5k_recv_ethernet(self, self->eth_frame)) > 0) {
-                w5x00_cb_process_ethernet(self, len, self->eth_frame);
+    w5x00_t *prev_active = w5x00_activate(self);
+    self->stats.polls++;
+
+    // Clear the interrupts before receiving, so a frame arriving while we drain raises it again.
+    // This also resets the IRQ signal on the W5100S, which needs Sn_IR writing
+    uint8_t ir = 0;
+    uint8_t sir = 0;
+    uint8_t sn_ir[_WIZCHIP_SOCK_NUM_];
+    w5x00_bus_enter();
+    if (w5x00_hal_pin_read(self->hw.intn_pin) == 0) {
+        // Only the MACRAW socket can interrupt unless hardware sockets are in use
+        sir = self->sn_in_use ? w5x00_get_socket_interrupts() : 1;
+        if (sir & 1) {
+            ir = getSn_IR(0);
+            if (ir) {
+                setSn_IR(0, ir);
             }
         }
+        if (sir & ~1u) {
+            w5x00_sn_interrupts(sir, sn_ir);
+        }
     }
 
-    wizchip_clrinterrupt(IK_SOCK_0);
-    #if _WIZCHIP_ == W5100S
-    setSn_IR(0, Sn_IR_RECV); // W5100S driver bug: must write to the Sn_IR register to reset the IRQ signal
+    if (ir & (Sn_IR_SENDOK | Sn_IR_TIMEOUT)) {
+        w5x00_send_complete(self, ir);
+    }
+    bool rx_pending = self->rx_more || self->napi_polling || (ir & Sn_IR_RECV);
+    #if !W5X00_RX_DRAIN
+    if (rx_pending) {
+        // Find the first frame before letting the bus go
+        w5x00_rx_read_head(self);
+    }
     #endif
+    w5x00_bus_exit();
+
+    if (sir & ~1u) {
+        w5x00_sn_dispatch(self, sn_ir);
+        // The handlers may have used the chip
+        self->rx_head_valid = false;
+    }
+
+    uint frames = 0;
+    if (rx_pending) {
+        if (self->napi_polling && !self->rx_more) {
+            // The interrupt is masked, so there's no better idea of when these frames arrived
+            self->rx_start_us = time_us_32();
+        } else if (!self->rx_more) {
+            uint32_t latency_us = time_us_32() - self->rx_start_us;
+            if (latency_us > self->stats.poll_latency_max_us) {
+                self->stats.poll_latency_max_us = latency_us;
+            }
+        }
+        self->rx_more = false;
+        #if W5X00_LWIP
+        bool rx_ready = (self->netif.flags & (NETIF_FLAG_UP | NETIF_FLAG_LINK_UP)) == (NETIF_FLAG_UP | NETIF_FLAG_LINK_UP);
+        #else
+        // Without lwIP the frames go to w5x00_cb_process_ethernet once the interface is up
+        bool rx_ready = self->itf_state != 0;
+        #endif
+        if (rx_ready) {
+            uint32_t bytes = 0;
+            while (frames < self->rx_budget_frames && bytes < self->rx_budget_bytes) {
+                uint n = w5x00_recv_ethernet_batch(self, self->rx_budget_frames - frames, self->rx_budget_bytes - bytes, &bytes);
+                if (n == 0) {
+                    break;
+                }
+                frames += n;
+            }
+            if (frames) {
+                w5x00_cb_rx_batch_done(self);
+            }
+            self->wakeup_frames += (uint16_t)frames;
+            if (frames >= self->rx_budget_frames || bytes >= self->rx_budget_bytes) {
+                // Out of budget. The interrupt has been cleared, so make sure we come back for the rest
+                self->rx_more = true;
+            }
+        }
+        // Anything may change the RX buffer before the next poll
+        self->rx_head_valid = false;
+    }
+
+    // NAPI style switching. Once a wakeup shows the link is busy, stop taking an interrupt per
+    // frame and keep polling with the budget above until the RX buffer stays empty
+    if (self->napi_polling) {
+        if (frames) {
+            self->napi_empty_polls = 0;
+        } else if (++self->napi_empty_polls >= self->napi_exit_polls) {
+            // W5X00_POST_POLL_HOOK re-arms the interrupt
+            self->napi_polling = false;
+        }
+    } else if (self->napi_enter_frames && self->wakeup_frames >= self->napi_enter_frames) {
+        self->napi_polling = true;
+        self->napi_empty_polls = 0;
+    }
 
-    if (w5x00_sleep == 0) {
-        // w5x00_ll_bus_sleep(self, true); // LWK TOOD??
+    if (self->rx_more) {
+        w5x00_schedule_internal_poll_dispatch(self);
+    } else if (self->napi_polling) {
+        // Not straight back to the poll worker, which would keep the context from its other work, and with
+        // threadsafe_background would never leave the IRQ. Due now, the timer list gets it there
+        async_context_add_at_time_worker_in_ms(w5x00_async_context, &self->napi_worker, 0);
+    } else if (self->wakeup_frames) {
+        w5x00_wakeup_done(self);
     }
 
+    w5x00_activate(prev_active);
+
     #ifdef W5X00_POST_POLL_HOOK
-    W5X00_POST_POLL_HOOK
+    W5X00_POST_POLL_HOOK(self)
     #endif
 
 }
@@ -357,78 +971,633 @@ int w5x00_ethernet_link_status(w5x00_t *self) {
     // }
 }
 
+void w5x00_sn_write_tx(w5x00_t *self, uint8_t sn, uint16_t ptr, const uint8_t *buf, uint16_t len) {
+    if (len == 0) {
+        return;
+    }
+    #if _WIZCHIP_ == W5500
+    // The W5500 wraps the offset within the socket buffer itself
+    (void)self;
+    WIZCHIP_WRITE_BUF(((uint32_t)ptr << 8) + (WIZCHIP_TXBUF_BLOCK(sn) << 3), (uint8_t *)buf, len);
+    #else
+    const w5x00_sn_buf_t *sb = &self->sn_buf[sn];
+    uint16_t offset = ptr & (sb->tx_size - 1);
+    if (offset + len > sb->tx_size) {
+        uint16_t size = sb->tx_size - offset;
+        WIZCHIP_WRITE_BUF(sb->tx_base + offset, (uint8_t *)buf, size);
+        buf += size;
+        len -= size;
+        offset = 0;
+    }
+    WIZCHIP_WRITE_BUF(sb->tx_base + offset, (uint8_t *)buf, len);
+    #endif
+}
+
+void w5x00_sn_read_rx(w5x00_t *self, uint8_t sn, uint16_t ptr, uint8_t *buf, uint16_t len) {
+    if (len == 0) {
+        return;
+    }
+    #if _WIZCHIP_ == W5500
+    (void)self;
+    WIZCHIP_READ_BUF(((uint32_t)ptr << 8) + (WIZCHIP_RXBUF_BLOCK(sn) << 3), buf, len);
+    #else
+    const w5x00_sn_buf_t *sb = &self->sn_buf[sn];
+    uint16_t offset = ptr & (sb->rx_size - 1);
+    if (offset + len > sb->rx_size) {
+        uint16_t size = sb->rx_size - offset;
+        WIZCHIP_READ_BUF(sb->rx_base + offset, buf, size);
+        buf += size;
+        len -= size;
+        offset = 0;
+    }
+    WIZCHIP_READ_BUF(sb->rx_base + offset, buf, len);
+    #endif
+}
+
+static void w5x00_send_commit(w5x00_t *self, uint16_t end) {
+    setSn_TX_WR(0, end);
+    self->tx_wr = end;
+    setSn_CR(0, Sn_CR_SEND);
+    while (getSn_CR(0));
+    self->tx_busy = true;
+}
+
+// The chip timed out sending or its RX ring got out of step. Take the netif down, the link monitor
+// brings it back up if the PHY still has a link
+static void w5x00_link_lost(w5x00_t *self) {
+    self->phy_status = W5X00_PHY_UNKNOWN;
+    #if W5X00_PIPE
+    if (get_core_num() != async_context_core_num(w5x00_async_context)) {
+        // lwIP belongs to the other core
+        w5x00_pipe_link_lost = true;
+        async_context_set_work_pending(w5x00_async_context, &self->poll_worker);
+        return;
+    }
+    #endif
+    w5x00_cb_tcpip_set_link_down(self);
+}
+
+// Handle SENDOK/TIMEOUT for the frame in flight, and send the next queued frame
+static void w5x00_send_complete(w5x00_t *self, uint8_t ir) {
+    if (!self->tx_busy) {
+        return;
+    }
+    self->tx_busy = false;
+    self->tx_rd = self->tx_wr;
+    if (ir & Sn_IR_TIMEOUT) {
+        // printf("wiznet5k_send_ethernet: fatal error\n");
+        w5x00_link_lost(self);
+        // netif_set_down(&self->netif); // ?? µPy
+    }
+    if (self->tx_queue_count) {
+        uint16_t end = self->tx_queue[self->tx_queue_head];
+        self->tx_queue_head = (self->tx_queue_head + 1) % W5X00_TX_QUEUE_LEN;
+        self->tx_queue_count--;
+        w5x00_send_commit(self, end);
+    }
+}
+
+// Check for completion of the frame in flight, optionally waiting for it
+static void w5x00_send_reap(w5x00_t *self, bool wait) {
+    if (!self->tx_busy) {
+        return;
+    }
+    uint8_t ir;
+    do {
+        ir = getSn_IR(0) & (Sn_IR_SENDOK | Sn_IR_TIMEOUT);
+    } while (wait && !ir);
+    if (ir) {
+        setSn_IR(0, ir);
+        w5x00_send_complete(self, ir);
+    }
+}
+
+// Writes a frame into the socket 0 TX ring and sends it, or queues it behind the frame being sent
+static int w5x00_send_frame(w5x00_t *self, size_t len, const void *buf, bool is_pbuf) {
+    const uint16_t tx_size = self->sn_buf[0].tx_size;
+    if (len > tx_size) {
+        self->stats.tx_fail++;
+        return -W5X00_EINVAL;
+    }
+
+    if (!self->tx_synced) {
+        // The socket may have been (re)opened since we last looked
+        self->tx_ptr = self->tx_wr = self->tx_rd = getSn_TX_WR(0);
+        self->tx_busy = false;
+        self->tx_queue_head = self->tx_queue_count = 0;
+        self->tx_synced = true;
+    }
+
+    // Only wait for the previous SEND if there's no room for this frame
+    while (self->tx_busy && (self->tx_queue_count == W5X00_TX_QUEUE_LEN ||
+            (uint16_t)(self->tx_ptr - self->tx_rd) + len > tx_size)) {
+        w5x00_send_reap(self, true);
+    }
+
+    // Write the frame straight into the socket 0 TX ring, rather than via sendto which
+    // would need it flattened into a single buffer first
+    uint16_t ptr = self->tx_ptr;
+    #if W5X00_LWIP
+    if (is_pbuf) {
+        for (const struct pbuf *q = buf; q != NULL; q = q->next) {
+            w5x00_sn_write_tx(self, 0, ptr, q->payload, q->len);
+            ptr += q->len;
+        }
+    } else
+    #endif
+    {
+        (void)is_pbuf;
+        w5x00_sn_write_tx(self, 0, ptr, buf, (uint16_t)len);
+        ptr += len;
+    }
+    self->tx_ptr = ptr;
+    self->stats.tx_frames++;
+    self->stats.tx_bytes += len;
+
+    if (!self->tx_busy) {
+        w5x00_send_commit(self, ptr);
+    } else {
+        // w5x00_poll_func sends it when the SENDOK interrupt for the current frame arrives
+        self->tx_queue[(self->tx_queue_head + self->tx_queue_count) % W5X00_TX_QUEUE_LEN] = ptr;
+        self->tx_queue_count++;
+    }
+    return 0;
+}
+
 int w5x00_send_ethernet(w5x00_t *self, size_t len, const void *buf, bool is_pbuf) {
+    // Not W5X00_ENTER, the bus is only taken around the frame
     W5X00_THREAD_ENTER;
+    w5x00_t *prev_active = w5x00_activate(self);
+    W5X00_TRACE_EVENT(W5X00_TRACE_TX_BEGIN, len);
     int ret = w5x00_ensure_up(self);
     if (ret) {
-        W5X00_THREAD_EXIT;
-        return ret;
+        self->stats.tx_fail++;
+    } else {
+        #if W5X00_PIPE
+        // Core 1 does the sending, and needs the bus to free a TX slot
+        ret = w5x00_pipe_send(self, len, buf, is_pbuf);
+        #else
+        w5x00_bus_enter();
+        ret = w5x00_send_frame(self, len, buf, is_pbuf);
+        w5x00_bus_exit();
+        #endif
+    }
+    if (!ret && is_pbuf) {
+        w5x00_capture_tap(self, W5X00_CAPTURE_TX, buf);
     }
 
-    uint8_t ip[4] = {1, 1, 1, 1}; // dummy
-    ret = WIZCHIP_EXPORT(sendto)(0, (uint8_t *)buf, len, ip, 11); // dummy port
+    W5X00_TRACE_EVENT(W5X00_TRACE_TX_END, len);
+    w5x00_activate(prev_active);
+    W5X00_THREAD_EXIT;
+    return ret;
+}
 
-    if (ret != len) {
-        // printf("wiznet5k_send_ethernet: fatal error %d\n", ret);
-        w5x00_cb_tcpip_set_link_down(self);
-        // netif_set_down(&self->netif); // ?? µPy
+// Check the length from a MACRAW header (which includes the header itself) against the bytes available
+static inline bool w5x00_rx_frame_len_valid(uint16_t len, uint16_t avail) {
+    return len > 2 && len <= avail && len - 2 <= W5X00_MAX_FRAME_SIZE;
+}
 
-        ret = -1;
-    } else {
-        ret = 0;
+static void w5x00_rx_occupancy_record(w5x00_t *self, uint16_t rsr) {
+    if (rsr > self->stats.rx_occupancy_max) {
+        self->stats.rx_occupancy_max = rsr;
+    }
+    if (rsr + 2 + W5X00_MAX_FRAME_SIZE > self->sn_buf[0].rx_size) {
+        self->stats.rx_buf_full++;
     }
+}
 
-    W5X00_THREAD_EXIT;
+static bool w5x00_mcast_subscribed(w5x00_t *self, const uint8_t *mac) {
+    if (self->mcast_overflow) {
+        return true;
+    }
+    for (uint i = 0; i < W5X00_MCAST_FILTER_LEN; i++) {
+        if (self->mcast_filter[i].refs && memcmp(self->mcast_filter[i].mac, mac, 6) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    return ret;
+static bool w5x00_rx_rule_match(const w5x00_rx_rule_t *rule, const uint8_t *frame, uint16_t len) {
+    if (len < 14) {
+        return false;
+    }
+    uint16_t ethertype = (uint16_t)((frame[12] << 8) | frame[13]);
+    if (rule->ethertype && ethertype != rule->ethertype) {
+        return false;
+    }
+    if (rule->ip_proto || rule->dst_port) {
+        const uint8_t *ip = frame + 14;
+        if (ethertype != 0x0800 || len < 14 + 20) {
+            return false;
+        }
+        if (rule->ip_proto && ip[9] != rule->ip_proto) {
+            return false;
+        }
+        if (rule->dst_port) {
+            // Only the first fragment carries the ports
+            uint16_t ihl = (ip[0] & 0xf) * 4;
+            if ((ip[9] != 6 && ip[9] != 17) || ihl < 20 || (((ip[6] << 8) | ip[7]) & 0x1fff) || len < 14 + ihl + 4) {
+                return false;
+            }
+            if (((ip[ihl + 2] << 8) | ip[ihl + 3]) != rule->dst_port) {
+                return false;
+            }
+        }
+    }
+    if (rule->mask) {
+        if (len < rule->offset + 4) {
+            return false;
+        }
+        const uint8_t *p = frame + rule->offset;
+        uint32_t word = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        if ((word & rule->mask) != rule->match) {
+            return false;
+        }
+    }
+    return true;
 }
 
-// Stores the frame in self->eth_frame and returns number of bytes in the frame, 0 for no frame
-uint16_t wiznet5k_recv_ethernet(w5x00_t *self, const uint8_t *buf) {
-    W5X00_THREAD_ENTER;
-    uint16_t len = getSn_RX_RSR(0);
-    if (len == 0) {
-        W5X00_THREAD_EXIT;
+// Broadcasts we must see whatever the rate, ARP asking for our address and DHCP replies
+static bool w5x00_bcast_essential(w5x00_t *self, const uint8_t *frame, uint16_t len) {
+    if (len < 14) {
+        return false;
+    }
+    uint16_t ethertype = (uint16_t)((frame[12] << 8) | frame[13]);
+    if (ethertype == 0x0806) {
+        #if W5X00_LWIP && LWIP_IPV4
+        #if W5X00_PIPE
+        // Core 1 gets here, and can't look at the netif
+        const uint32_t *ip4_addr = &self->pipe_ip4_addr;
+        #else
+        const uint32_t *ip4_addr = &netif_ip4_addr(&self->netif)->addr;
+        #endif
+        // Target protocol address of the ARP packet
+        return len >= 42 && memcmp(frame + 38, ip4_addr, 4) == 0;
+        #else
+        (void)self;
+        return true;
+        #endif
+    }
+    if (ethertype == 0x0800 && len >= 14 + 20 && frame[14 + 9] == 17) {
+        uint16_t ihl = (frame[14] & 0xf) * 4;
+        if (len >= 14 + ihl + 4) {
+            const uint8_t *udp = frame + 14 + ihl;
+            return ((udp[2] << 8) | udp[3]) == 68;
+        }
+    }
+    return false;
+}
+
+static bool w5x00_bcast_admit(w5x00_t *self, const uint8_t *frame, uint16_t len) {
+    if (!self->bcast_cost_us || w5x00_bcast_essential(self, frame, len)) {
+        return true;
+    }
+    uint32_t now = time_us_32();
+    uint32_t credit = self->bcast_credit_us + (now - self->bcast_last_us);
+    if (credit > self->bcast_credit_max_us || credit < self->bcast_credit_us) {
+        credit = self->bcast_credit_max_us;
+    }
+    self->bcast_last_us = now;
+    if (credit < self->bcast_cost_us) {
+        self->bcast_credit_us = credit;
+        self->stats.rx_bcast_limited++;
+        return false;
+    }
+    self->bcast_credit_us = credit - self->bcast_cost_us;
+    return true;
+}
+
+// Decide from the start of a frame whether to pass it on, before anything is allocated for it
+static bool w5x00_rx_admit(w5x00_t *self, const uint8_t *frame, uint16_t len, uint8_t *prio) {
+    *prio = W5X00_RX_PRIO_BULK;
+    if (self->rx_rule_count) {
+        bool accept = self->rx_rule_default_accept;
+        for (uint i = 0; i < self->rx_rule_count; i++) {
+            if (w5x00_rx_rule_match(&self->rx_rules[i], frame, len)) {
+                accept = self->rx_rules[i].accept;
+                *prio = self->rx_rules[i].prio;
+                break;
+            }
+        }
+        if (!accept) {
+            self->stats.rx_rule_filtered++;
+            return false;
+        }
+    }
+    static const uint8_t broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    // Promiscuous mode only turns off the multicast MAC filter, the broadcast limit and rules still apply.
+    // The broadcast limit comes last, so frames that would be dropped anyway don't use up its credit
+    if (len >= 6 && (frame[0] & 1)) {
+        if (memcmp(frame, broadcast, 6) == 0) {
+            if (!w5x00_bcast_admit(self, frame, len)) {
+                return false;
+            }
+        } else if (!self->promiscuous && !w5x00_mcast_subscribed(self, frame)) {
+            self->stats.rx_mcast_filtered++;
+            return false;
+        }
+    }
+    return true;
+}
+
+// The ring is out of step, drop everything that is pending. Called with the bus held, the caller
+// follows it with w5x00_link_lost once it has let the bus go
+static void w5x00_rx_flush(w5x00_t *self, uint16_t rd, uint16_t rsr) {
+    // printf("wiznet5k_recv_ethernet: fatal error rsr=%u\n", rsr);
+    setSn_RX_RD(0, rd + rsr);
+    setSn_CR(0, Sn_CR_RECV);
+    while (getSn_CR(0));
+    // netif_set_down(&self->netif); // ?? µPy
+    self->stats.rx_errors++;
+    #if W5X00_RX_DRAIN
+    self->rx_drain_next_len = 0;
+    self->rx_drain_held = 0;
+    #endif
+}
+
+// Reads the RX size and, if there's a frame, the start of it into rx_head. The bus must be held.
+// In MACRAW mode each frame is preceded by a 2 byte big-endian length, which includes itself.
+// Reading the start of the frame with it is for filtering, and saves w5x00_read_ethernet reading it again
+static void w5x00_rx_read_head(w5x00_t *self) {
+    uint16_t rsr = getSn_RX_RSR(0);
+    self->rx_head_rsr = rsr;
+    if (rsr) {
+        self->rx_head_rd = getSn_RX_RD(0);
+        self->rx_head_len = MIN(rsr, sizeof(self->rx_head));
+        w5x00_sn_read_rx(self, 0, self->rx_head_rd, self->rx_head, self->rx_head_len);
+    }
+    self->rx_head_valid = true;
+}
+
+// Passes the next frame to w5x00_cb_process_ethernet and returns number of bytes in the frame, 0 for no frame
+// The callback pulls the payload with w5x00_read_ethernet, so the frame goes straight from the chip to its destination.
+// Not W5X00_BUS_ENTER, the callback calls into lwIP. The bus is taken to find the frame, unless the
+// poll read it ahead, and again to release it and read ahead the next one
+uint16_t wiznet5k_recv_ethernet(w5x00_t *self) {
+    w5x00_t *prev_active = W5X00_ENTER(self);
+    if (!self->rx_head_valid) {
+        w5x00_bus_enter();
+        w5x00_rx_read_head(self);
+        w5x00_bus_exit();
+    }
+    self->rx_head_valid = false;
+    uint16_t rsr = self->rx_head_rsr;
+    if (rsr == 0) {
+        W5X00_EXIT(prev_active);
         return 0;
     }
+    w5x00_rx_occupancy_record(self, rsr);
+
+    uint16_t rd = self->rx_head_rd;
+    uint8_t *head = self->rx_head;
+    uint16_t head_len = self->rx_head_len;
+    uint16_t len = (uint16_t)((head[0] << 8) | head[1]);
+    if (!w5x00_rx_frame_len_valid(len, rsr)) {
+        w5x00_bus_enter();
+        w5x00_rx_flush(self, rd, rsr);
+        w5x00_bus_exit();
+        w5x00_link_lost(self);
+        W5X00_EXIT(prev_active);
+        return 0;
+    }
+    len -= 2;
+
+    self->rx_ptr = rd + 2;
+    self->rx_len = len;
+    self->rx_src = NULL;
+    self->rx_peek_len = MIN(head_len - 2, len);
+    if (w5x00_rx_admit(self, head + 2, self->rx_peek_len, &self->rx_prio)) {
+        w5x00_rx_latency_record(self);
+        w5x00_cb_process_ethernet(self, len);
+    }
+    self->rx_len = 0;
+    self->rx_peek_len = 0;
+    self->stats.rx_frames++;
+    self->stats.rx_bytes += len;
+
+    // Release the frame whether or not the callback consumed it
+    w5x00_bus_enter();
+    setSn_RX_RD(0, rd + 2 + len);
+    setSn_CR(0, Sn_CR_RECV);
+    while (getSn_CR(0));
+    #if !W5X00_RX_DRAIN
+    // A drain burst reads its own heads
+    w5x00_rx_read_head(self);
+    #endif
+    w5x00_bus_exit();
 
-    uint8_t ip[4] = {1, 1, 1, 1}; // dummy
-    uint16_t port;
-    int ret = WIZCHIP_EXPORT(recvfrom)(0, (uint8_t *)buf, 1514, ip, &port);
-    if (ret <= 0) {
-        // printf("wiznet5k_recv_ethernet: fatal error len=%u ret=%d\n", len, ret);
-        w5x00_cb_tcpip_set_link_down(self);
-        // netif_set_down(&self->netif); // ?? µPy
+    W5X00_EXIT(prev_active);
+
+    return len;
+}
+
+void w5x00_read_ethernet(w5x00_t *self, uint16_t offset, uint8_t *buf, uint16_t len) {
+    W5X00_THREAD_LOCK_CHECK;
+    assert(offset + len <= self->rx_len);
+    if (self->rx_src) {
+        memcpy(buf, self->rx_src + offset, len);
+        self->stats.copy_bytes += len;
+    } else {
+        if (offset < self->rx_peek_len) {
+            uint16_t n = MIN(len, self->rx_peek_len - offset);
+            memcpy(buf, self->rx_head + 2 + offset, n);
+            self->stats.copy_bytes += n;
+            buf += n;
+            offset += n;
+            len -= n;
+        }
+        if (len) {
+            w5x00_bus_enter();
+            w5x00_sn_read_rx(self, 0, self->rx_ptr + offset, buf, len);
+            w5x00_bus_exit();
+        }
+    }
+}
 
-        W5X00_THREAD_EXIT;
+#if W5X00_RX_DRAIN
+// Reads as many whole frames as fit in rx_drain_buf and the budget with one burst, passes them to
+// w5x00_cb_process_ethernet, then releases them all with a single RECV command. The bus is let go
+// while the frames are delivered from rx_drain_buf. As with wiznet5k_recv_ethernet the frame that
+// crosses max_bytes is still read
+static uint w5x00_recv_ethernet_drain(w5x00_t *self, uint max_frames, uint32_t max_bytes, uint32_t *bytes) {
+    w5x00_t *prev_active = W5X00_ENTER(self);
+    w5x00_bus_enter();
+    uint16_t rsr = getSn_RX_RSR(0);
+    if (rsr == 0) {
+        w5x00_bus_exit();
+        W5X00_EXIT(prev_active);
         return 0;
     }
+    w5x00_rx_occupancy_record(self, rsr);
+
+    uint16_t rd = getSn_RX_RD(0);
+    const uint8_t *data;
+    uint16_t avail;
+    if (self->rx_drain_held && self->rx_drain_held_ptr == rd) {
+        // Left over from the last burst, still unreleased on the chip
+        data = self->rx_drain_buf + self->rx_drain_held_off;
+        avail = self->rx_drain_held;
+    } else {
+        uint16_t limit = MIN(rsr, sizeof(self->rx_drain_buf));
+        avail = limit;
+        if (avail > max_bytes) {
+            avail = (uint16_t)max_bytes;
+        }
+        if (avail < rsr || max_frames == 1) {
+            // RSR only counts whole frames, so reading all of it can't stop part way into one. Reading less
+            // can, so make sure the burst holds at least the first frame. A burst that stopped part way
+            // into it will have noted its length
+            uint16_t len;
+            if (self->rx_drain_next_len && self->rx_drain_next_ptr == rd) {
+                len = self->rx_drain_next_len;
+            } else {
+                uint8_t head[2];
+                w5x00_sn_read_rx(self, 0, rd, head, sizeof(head));
+                len = (uint16_t)((head[0] << 8) | head[1]);
+            }
+            if (!w5x00_rx_frame_len_valid(len, rsr)) {
+                w5x00_rx_flush(self, rd, rsr);
+                w5x00_bus_exit();
+                w5x00_link_lost(self);
+                W5X00_EXIT(prev_active);
+                return 0;
+            }
+            if (len > limit) {
+                // Leave it to wiznet5k_recv_ethernet, which reads it in place
+                w5x00_bus_exit();
+                W5X00_EXIT(prev_active);
+                return 0;
+            }
+            if (max_frames == 1 || 2 * len > avail) {
+                // Another frame this size wouldn't fit the budget, so read just this one and the length
+                // of the next
+                avail = MIN(limit, len + 2);
+            }
+        }
+        self->rx_drain_next_len = 0;
+        w5x00_sn_read_rx(self, 0, rd, self->rx_drain_buf, avail);
+        data = self->rx_drain_buf;
+    }
+    self->rx_drain_held = 0;
+    w5x00_bus_exit();
+
+    uint frames = 0;
+    uint16_t offset = 0;
+    uint32_t taken = 0;
+    bool flush = false;
+    while (offset + 2 <= avail) {
+        const uint8_t *head = data + offset;
+        uint16_t len = (uint16_t)((head[0] << 8) | head[1]);
+        if (!w5x00_rx_frame_len_valid(len, rsr - offset)) {
+            flush = true;
+            break;
+        }
+        if (len > avail - offset) {
+            // Not all of this frame was read, note its length for the next burst
+            self->rx_drain_next_len = len;
+            self->rx_drain_next_ptr = rd + offset;
+            break;
+        }
+        if (frames == max_frames || taken >= max_bytes) {
+            // Out of budget, keep the rest for the next poll
+            self->rx_drain_held = avail - offset;
+            self->rx_drain_held_off = (uint16_t)(head - self->rx_drain_buf);
+            self->rx_drain_held_ptr = rd + offset;
+            break;
+        }
+        self->rx_ptr = rd + offset + 2;
+        self->rx_len = len - 2;
+        self->rx_src = head + 2;
+        if (w5x00_rx_admit(self, head + 2, len - 2, &self->rx_prio)) {
+            w5x00_rx_latency_record(self);
+            w5x00_cb_process_ethernet(self, len - 2);
+        }
+        self->rx_len = 0;
+        self->rx_src = NULL;
+        *bytes += len - 2;
+        taken += len - 2;
+        self->stats.rx_frames++;
+        self->stats.rx_bytes += len - 2u;
+        offset += len;
+        frames++;
+    }
 
-    W5X00_THREAD_EXIT;
+    w5x00_bus_enter();
+    if (flush) {
+        w5x00_rx_flush(self, rd, rsr);
+    } else if (offset) {
+        setSn_RX_RD(0, rd + offset);
+        setSn_CR(0, Sn_CR_RECV);
+        while (getSn_CR(0));
+    }
+    w5x00_bus_exit();
+    if (flush) {
+        w5x00_link_lost(self);
+    }
 
-    return ret;
+    W5X00_EXIT(prev_active);
+    return frames;
+}
+#endif
+
+static uint w5x00_recv_ethernet_batch(w5x00_t *self, uint max_frames, uint32_t max_bytes, uint32_t *bytes) {
+    #if W5X00_RX_DRAIN
+    uint frames = w5x00_recv_ethernet_drain(self, max_frames, max_bytes, bytes);
+    if (frames) {
+        return frames;
+    }
+    // Either nothing is pending or the next frame is too big for the drain buffer
+    #else
+    (void)max_frames;
+    (void)max_bytes;
+    #endif
+    uint16_t len = wiznet5k_recv_ethernet(self);
+    *bytes += len;
+    return len ? 1 : 0;
+}
+
+void w5x00_set_rx_budget(w5x00_t *self, uint16_t max_frames, uint32_t max_bytes) {
+    w5x00_t *prev_active = W5X00_ENTER(self);
+    self->rx_budget_frames = max_frames ? max_frames : 1;
+    self->rx_budget_bytes = max_bytes ? max_bytes : 1;
+    W5X00_EXIT(prev_active);
+}
+
+void w5x00_set_irq_coalesce(w5x00_t *self, uint16_t max_frames, uint32_t max_us) {
+    w5x00_t *prev_active = W5X00_ENTER(self);
+    self->coalesce_frames = max_frames ? max_frames : 1;
+    self->coalesce_us = self->coalesce_window_us = max_us;
+    W5X00_EXIT(prev_active);
+}
+
+void w5x00_set_napi_thresholds(w5x00_t *self, uint16_t enter_frames, uint16_t exit_empty_polls) {
+    w5x00_t *prev_active = W5X00_ENTER(self);
+    self->napi_enter_frames = enter_frames;
+    self->napi_exit_polls = exit_empty_polls ? exit_empty_polls : 1;
+    W5X00_EXIT(prev_active);
 }
 
 static int w5x00_ethernet_on(w5x00_t *self) {
-    W5X00_THREAD_ENTER;
+    w5x00_t *prev_active = W5X00_ENTER(self);
     int ret = w5x00_ensure_up(self);
     if (ret) {
-        W5X00_THREAD_EXIT;
+        W5X00_EXIT(prev_active);
         return ret;
     }
 
     // ret = w5x00_ll_wifi_on(self); // LWK TODO??
-    W5X00_THREAD_EXIT;
+    W5X00_EXIT(prev_active);
 
     return ret;
 }
 
 void w5x00_ethernet_set_up(w5x00_t *self, bool up) {
-    W5X00_THREAD_ENTER;
+    w5x00_t *prev_active = W5X00_ENTER(self);
     if (up) {
         if (self->itf_state == 0) {
             if (w5x00_ethernet_on(self) != 0) {
-                W5X00_THREAD_EXIT;
+                W5X00_EXIT(prev_active);
                 return;
             }
             // w5x00_ethernet_pm(self, W5X00_DEFAULT_PM);
@@ -437,40 +1606,531 @@ void w5x00_ethernet_set_up(w5x00_t *self, bool up) {
             self->itf_state = 1;
         }
     }
-    W5X00_THREAD_EXIT;
+    W5X00_EXIT(prev_active);
 }
 
 int w5x00_ethernet_get_mac(w5x00_t *self, uint8_t mac[6]) {
-    (void)self;
-    w5x00_hal_get_mac(W5X00_HAL_MAC_ETH0, &mac[0]);
+    w5x00_hal_get_mac(W5X00_HAL_MAC_ETH0 + self->idx, &mac[0]);
     return 0;
 }
 
 int w5x00_ethernet_join(w5x00_t *self) {
-    W5X00_THREAD_ENTER;
+    w5x00_t *prev_active = W5X00_ENTER(self);
     if (! self->itf_state) {
-        W5X00_THREAD_EXIT;
+        W5X00_EXIT(prev_active);
         return -W5X00_EPERM;
     }
 
     int ret = w5x00_ensure_up(self);
     if (ret) {
-        W5X00_THREAD_EXIT;
+        W5X00_EXIT(prev_active);
         return ret;
     }
 
-    // ret = w5x00_ll_wifi_join(self); // LWK TDOO ?????
-    w5x00_cb_tcpip_set_link_up(self);
-    if (ret == 0) {
-        self->ethernet_link_state = W5X00_LINK_JOIN; // LWK FIX WIFI_JOIN_STATE_ACTIVE;
-    }
+    // The netif link follows the PHY from now on, w5x00_link_update brings it up if there's a cable
+    self->joined = true;
+    self->phy_status = W5X00_PHY_UNKNOWN;
+    w5x00_link_update(self);
 
-    W5X00_THREAD_EXIT;
+    W5X00_EXIT(prev_active);
 
     return ret;
 }
 
 int w5x00_ethernet_leave(w5x00_t *self) {
-    // Disassociate with SSID
-    // return w5x00_ioctl(self, CYW43_IOCTL_SET_DISASSOC, 0, NULL); // LWK ????
+    w5x00_t *prev_active = W5X00_ENTER(self);
+    if (self->joined) {
+        self->joined = false;
+        if (self->ethernet_link_state == W5X00_LINK_JOIN) {
+            w5x00_cb_tcpip_set_link_down(self);
+        }
+        self->ethernet_link_state = W5X00_LINK_DOWN;
+    }
+    W5X00_EXIT(prev_active);
+    return 0;
+}
+
+// Read the PHY status register, which is cheap enough to do from a slow timer
+static uint8_t w5x00_read_phy_status(void) {
+    uint8_t status = 0;
+    #if _WIZCHIP_ == W5500
+    uint8_t cfgr = getPHYCFGR();
+    if (cfgr & PHYCFGR_LNK_ON) {
+        status |= W5X00_PHY_LINK;
+    }
+    if (cfgr & PHYCFGR_SPD_100) {
+        status |= W5X00_PHY_100M;
+    }
+    if (cfgr & PHYCFGR_DPX_FULL) {
+        status |= W5X00_PHY_FULL_DUPLEX;
+    }
+    #else
+    // The W5100S reports 10M and half duplex rather than 100M and full duplex
+    uint8_t sr = getPHYSR();
+    if (sr & PHYSR_LNK) {
+        status |= W5X00_PHY_LINK;
+    }
+    if (!(sr & PHYSR_SPD)) {
+        status |= W5X00_PHY_100M;
+    }
+    if (!(sr & PHYSR_DPX)) {
+        status |= W5X00_PHY_FULL_DUPLEX;
+    }
+    #endif
+    return status;
 }
+
+static void w5x00_link_update(w5x00_t *self) {
+    W5X00_THREAD_LOCK_CHECK;
+    w5x00_bus_enter();
+    uint8_t status = w5x00_read_phy_status();
+    w5x00_bus_exit();
+    if (status == self->phy_status) {
+        return;
+    }
+    bool was_up = self->phy_status != W5X00_PHY_UNKNOWN && (self->phy_status & W5X00_PHY_LINK);
+    bool up = status & W5X00_PHY_LINK;
+    bool report = self->phy_status == W5X00_PHY_UNKNOWN || up != was_up;
+    self->phy_status = status;
+    if (!report) {
+        // only the speed or duplex changed
+        return;
+    }
+    W5X00_DEBUG("W5X00: link %s\n", up ? "up" : "down");
+    if (self->joined) {
+        if (up) {
+            // lwIP restarts DHCP when the link comes back
+            w5x00_cb_tcpip_set_link_up(self);
+            self->ethernet_link_state = W5X00_LINK_JOIN;
+        } else {
+            w5x00_cb_tcpip_set_link_down(self);
+            self->ethernet_link_state = W5X00_LINK_DOWN;
+        }
+    }
+    if (self->link_cb) {
+        self->link_cb(self, up, self->link_cb_arg);
+    }
+}
+
+void w5x00_get_stats(w5x00_t *self, w5x00_stats_t *stats) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(self);
+    // Holding the bus as well, core 1 updates some of these with W5X00_PIPE
+    *stats = self->stats;
+    // not including this call
+    stats->lock_us = w5x00_lock_us;
+    stats->lock_max_us = w5x00_lock_max_us;
+    stats->lock_acquires = w5x00_lock_acquires - (w5x00_lock_depth == 1);
+    stats->bus_us = w5x00_bus_us;
+    stats->bus_max_us = w5x00_bus_max_us;
+    stats->bus_acquires = w5x00_bus_acquires - (w5x00_bus_depth == 1);
+    stats->bus_nested = w5x00_bus_nested;
+    W5X00_BUS_EXIT(prev_active);
+}
+
+void w5x00_reset_stats(w5x00_t *self) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(self);
+    memset(&self->stats, 0, sizeof(self->stats));
+    w5x00_lock_us = 0;
+    w5x00_lock_max_us = 0;
+    w5x00_lock_acquires = 0;
+    w5x00_bus_us = 0;
+    w5x00_bus_max_us = 0;
+    w5x00_bus_acquires = 0;
+    w5x00_bus_nested = 0;
+    W5X00_BUS_EXIT(prev_active);
+}
+
+uint32_t w5x00_stats_rx_latency_percentile(const w5x00_stats_t *stats, uint percent) {
+    uint64_t total = 0;
+    for (uint i = 0; i < W5X00_RX_LATENCY_BUCKETS; i++) {
+        total += stats->rx_latency[i];
+    }
+    uint64_t want = (total * percent + 99) / 100;
+    uint64_t count = 0;
+    for (uint i = 0; i < W5X00_RX_LATENCY_BUCKETS - 1; i++) {
+        count += stats->rx_latency[i];
+        if (count >= want) {
+            return 1u << i;
+        }
+    }
+    // the last bucket has no upper bound
+    return UINT32_MAX;
+}
+
+uint32_t w5x00_stats_spi_throughput_limit(const w5x00_stats_t *stats, uint32_t spi_hz) {
+    if (!stats->spi_bytes) {
+        return 0;
+    }
+    // Each bus byte takes 8 clocks, and carries (rx_bytes + tx_bytes) / spi_bytes frame bytes
+    uint64_t frame_bytes = (uint64_t)stats->rx_bytes + stats->tx_bytes;
+    return (uint32_t)MIN(frame_bytes * (spi_hz / 8) / stats->spi_bytes, UINT32_MAX);
+}
+
+// The filter settings below are read by w5x00_rx_admit, which with W5X00_PIPE runs on core 1 holding
+// only the bus, so they're changed with the bus held too
+
+void w5x00_set_broadcast_limit(w5x00_t *self, uint32_t per_second, uint32_t burst) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(self);
+    self->bcast_cost_us = per_second ? 1000000 / MIN(per_second, 1000000) : 0;
+    self->bcast_credit_max_us = self->bcast_credit_us = self->bcast_cost_us * MAX(burst, 1);
+    self->bcast_last_us = time_us_32();
+    W5X00_BUS_EXIT(prev_active);
+}
+
+int w5x00_set_rx_filter(w5x00_t *self, const w5x00_rx_rule_t *rules, uint count, bool default_accept) {
+    if (count > W5X00_RX_FILTER_RULES) {
+        return -W5X00_EINVAL;
+    }
+    w5x00_t *prev_active = W5X00_BUS_ENTER(self);
+    if (count) {
+        memcpy(self->rx_rules, rules, count * sizeof(w5x00_rx_rule_t));
+    }
+    self->rx_rule_count = (uint8_t)count;
+    self->rx_rule_default_accept = default_accept;
+    self->rx_prio_used = false;
+    for (uint i = 0; i < count; i++) {
+        if (rules[i].accept && rules[i].prio != W5X00_RX_PRIO_BULK) {
+            self->rx_prio_used = true;
+        }
+    }
+    W5X00_BUS_EXIT(prev_active);
+    return 0;
+}
+
+int w5x00_ethernet_update_multicast_filter(w5x00_t *self, const uint8_t mac[6], bool add) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(self);
+    int free_slot = -1;
+    for (uint i = 0; i < W5X00_MCAST_FILTER_LEN; i++) {
+        if (self->mcast_filter[i].refs && memcmp(self->mcast_filter[i].mac, mac, 6) == 0) {
+            // Several groups can map to the same MAC
+            if (add) {
+                self->mcast_filter[i].refs++;
+            } else {
+                self->mcast_filter[i].refs--;
+            }
+            W5X00_BUS_EXIT(prev_active);
+            return 0;
+        }
+        if (!self->mcast_filter[i].refs && free_slot < 0) {
+            free_slot = (int)i;
+        }
+    }
+    if (add) {
+        if (free_slot >= 0) {
+            memcpy(self->mcast_filter[free_slot].mac, mac, 6);
+            self->mcast_filter[free_slot].refs = 1;
+        } else {
+            self->mcast_overflow++;
+        }
+    } else if (self->mcast_overflow) {
+        self->mcast_overflow--;
+    }
+    W5X00_BUS_EXIT(prev_active);
+    return 0;
+}
+
+int w5x00_set_promiscuous(w5x00_t *self, bool on) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(self);
+    int ret = 0;
+    // The bus is held throughout, so with W5X00_PIPE core 1 keeps off the chip and its TX state
+    self->promiscuous = on;
+    if (self->poll && getSn_SR(0) == SOCK_MACRAW) {
+        // MFEN only takes effect when the socket is opened, so reopen it. Let queued frames go first
+        while (self->tx_busy) {
+            w5x00_send_reap(self, true);
+        }
+        uint8_t mr2 = getSn_MR2(0);
+        WIZCHIP_EXPORT(close)(0);
+        ret = WIZCHIP_EXPORT(socket)(0, Sn_MR_MACRAW | (on ? 0 : Sn_MR_MFEN), 0, 0);
+        setSn_MR2(0, mr2);
+        // OPEN resets the TX and RX pointers
+        self->tx_synced = false;
+        #if W5X00_RX_DRAIN
+        self->rx_drain_next_len = 0;
+        self->rx_drain_held = 0;
+        #endif
+        if (ret != 0) {
+            ret = -W5X00_EIO;
+        }
+    }
+    W5X00_BUS_EXIT(prev_active);
+    return ret;
+}
+
+void w5x00_set_link_callback(w5x00_t *self, w5x00_link_cb_t cb, void *arg) {
+    w5x00_t *prev_active = W5X00_ENTER(self);
+    self->link_cb = cb;
+    self->link_cb_arg = arg;
+    W5X00_EXIT(prev_active);
+}
+
+uint w5x00_ethernet_link_speed(w5x00_t *self) {
+    uint8_t status = self->phy_status;
+    if (status == W5X00_PHY_UNKNOWN || !(status & W5X00_PHY_LINK)) {
+        return 0;
+    }
+    return (status & W5X00_PHY_100M) ? 100 : 10;
+}
+
+bool w5x00_ethernet_link_full_duplex(w5x00_t *self) {
+    uint8_t status = self->phy_status;
+    return status != W5X00_PHY_UNKNOWN && (status & W5X00_PHY_LINK) && (status & W5X00_PHY_FULL_DUPLEX);
+}
+
+#if W5X00_PIPE
+// Core 1's side of the pipeline
+
+static void w5x00_pipe_gpio_irq_handler(void) {
+    w5x00_t *self = &w5x00_state;
+    if (gpio_get_irq_event_mask(self->hw.intn_pin) & GPIO_IRQ_LEVEL_LOW) {
+        W5X00_TRACE_EVENT(W5X00_TRACE_IRQ, self->idx);
+        // Level triggered, so leave it disabled until w5x00_pipe_core1_task has serviced the chip
+        w5x00_set_irq_enabled(self, false);
+        w5x00_pipe_irq_us = time_us_32();
+        self->stats.irqs++;
+        __sev();
+    }
+}
+
+// Read frames straight into free RX slots, releasing them from the chip with a single RECV.
+// Returns true if frames were left behind for want of a slot
+static bool w5x00_pipe_recv(w5x00_t *self) {
+    uint16_t rsr = getSn_RX_RSR(0);
+    if (rsr == 0) {
+        return false;
+    }
+    w5x00_rx_occupancy_record(self, rsr);
+
+    bool more = false;
+    uint frames = 0;
+    uint16_t rd = getSn_RX_RD(0);
+    uint16_t offset = 0;
+    while (offset < rsr) {
+        w5x00_pipe_slot_t *slot = w5x00_pipe_ring_free(&w5x00_pipe_rx);
+        if (!slot) {
+            more = true;
+            break;
+        }
+        // The MACRAW length and the start of the frame, as for wiznet5k_recv_ethernet
+        uint16_t head_len = MIN(rsr - offset, 2 + W5X00_RX_PEEK_LEN);
+        w5x00_sn_read_rx(self, 0, rd + offset, slot->data, head_len);
+        uint16_t len = (uint16_t)((slot->data[0] << 8) | slot->data[1]);
+        if (!w5x00_rx_frame_len_valid(len, rsr - offset)) {
+            w5x00_rx_flush(self, rd, rsr);
+            // On core 1 this only tells core 0, so it's fine with the bus held
+            w5x00_link_lost(self);
+            offset = 0;
+            break;
+        }
+        uint16_t peek_len = MIN(head_len - 2, len - 2);
+        if (w5x00_rx_admit(self, slot->data + 2, peek_len, &slot->prio)) {
+            if (len > head_len) {
+                w5x00_sn_read_rx(self, 0, rd + offset + head_len, slot->data + head_len, len - head_len);
+            }
+            slot->len = len - 2;
+            slot->start_us = w5x00_pipe_irq_us;
+            w5x00_pipe_ring_publish(&w5x00_pipe_rx);
+            frames++;
+        }
+        self->stats.rx_frames++;
+        self->stats.rx_bytes += len - 2u;
+        offset += len;
+    }
+
+    if (offset) {
+        // The space is only released here, so this is when the chip is fullest
+        w5x00_rx_occupancy_record(self, getSn_RX_RSR(0));
+        setSn_RX_RD(0, rd + offset);
+        setSn_CR(0, Sn_CR_RECV);
+        while (getSn_CR(0));
+    }
+    if (frames) {
+        async_context_set_work_pending(w5x00_async_context, &w5x00_state.poll_worker);
+    }
+    return more;
+}
+
+// One pass over the chip, returns true if anything was done
+static bool w5x00_pipe_service(w5x00_t *self) {
+    bool done = false;
+    bool rx = self->rx_more;
+    if (w5x00_hal_pin_read(self->hw.intn_pin) == 0) {
+        uint8_t sir = self->sn_in_use ? w5x00_get_socket_interrupts() : 1;
+        if (sir & 1) {
+            uint8_t ir = getSn_IR(0);
+            if (ir) {
+                setSn_IR(0, ir);
+                done = true;
+            }
+            if (ir & (Sn_IR_SENDOK | Sn_IR_TIMEOUT)) {
+                w5x00_send_complete(self, ir);
+            }
+            rx |= (ir & Sn_IR_RECV) != 0;
+        }
+        if ((sir & ~1u) && !w5x00_pipe_sn_pending) {
+            // The handlers run with lwIP, INTn stays low until core 0 has cleared these
+            w5x00_pipe_sn_pending = true;
+            async_context_set_work_pending(w5x00_async_context, &self->poll_worker);
+        }
+    }
+    if (rx) {
+        uint32_t frames = self->stats.rx_frames;
+        self->rx_more = w5x00_pipe_recv(self);
+        done |= frames != self->stats.rx_frames;
+    }
+    w5x00_pipe_slot_t *slot;
+    while ((slot = w5x00_pipe_ring_peek(&w5x00_pipe_tx)) != NULL) {
+        // A pbuf chain goes straight from where lwIP left it into the socket's TX ring
+        bool is_pbuf = slot->pbuf != NULL;
+        w5x00_send_frame(self, slot->len, is_pbuf ? slot->pbuf : slot->data, is_pbuf);
+        w5x00_pipe_ring_release(&w5x00_pipe_tx);
+        done = true;
+    }
+    return done;
+}
+
+void w5x00_pipe_core1_init(void) {
+    w5x00_t *self = &w5x00_state;
+    gpio_add_raw_irq_handler_with_order_priority(self->hw.intn_pin, w5x00_pipe_gpio_irq_handler, W5X00_GPIO_IRQ_HANDLER_PRIORITY);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+    // Bursts are waited for on this core, so take their completion here too
+    irq_add_shared_handler(DMA_IRQ_0 + W5X00_DMA_IRQ_NUM, w5x00_dma_irq_handler, W5X00_DMA_IRQ_HANDLER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0 + W5X00_DMA_IRQ_NUM, true);
+    w5x00_pipe_running = true;
+}
+
+bool w5x00_pipe_core1_poll(void) {
+    w5x00_t *self = &w5x00_state;
+    w5x00_bus_enter();
+    bool up = w5x00_pipe_up;
+    bool done = up && w5x00_pipe_service(self);
+    w5x00_bus_exit();
+    if (!done) {
+        // About to sleep until INTn fires, or core 0 queues a frame, frees a slot or clears the socket
+        // interrupts. While waiting for a slot or for core 0 INTn would only fire again straight away
+        w5x00_set_irq_enabled(self, up && !self->rx_more && !w5x00_pipe_sn_pending);
+    } else {
+        // INTn stays masked, so there's no better idea of when the frames of the next pass arrived
+        w5x00_pipe_irq_us = time_us_32();
+    }
+    return done;
+}
+
+void w5x00_pipe_core1_task(void) {
+    w5x00_pipe_core1_init();
+    for (;;) {
+        if (!w5x00_pipe_core1_poll()) {
+            __wfe();
+        }
+    }
+}
+
+// Core 0's side of the pipeline
+
+// Drop the pbuf references of the TX slots up to the given count, which core 1 must be done with
+static void w5x00_pipe_tx_reclaim(uint32_t upto) {
+    while (w5x00_pipe_tx_reclaimed != upto) {
+        w5x00_pipe_slot_t *slot = &w5x00_pipe_tx.slots[w5x00_pipe_tx_reclaimed & (w5x00_pipe_tx.len - 1)];
+        #if W5X00_LWIP
+        if (slot->pbuf) {
+            pbuf_free((struct pbuf *)slot->pbuf);
+        }
+        #endif
+        slot->pbuf = NULL;
+        w5x00_pipe_tx_reclaimed++;
+    }
+}
+
+// Queues the frame for core 1 to send. Doesn't wait for a slot, lwIP holds its lock while it sends and
+// would stall everything on core 0 until core 1 got round to it
+static int w5x00_pipe_send(w5x00_t *self, size_t len, const void *buf, bool is_pbuf) {
+    if (len > W5X00_MAX_FRAME_SIZE) {
+        self->stats.tx_fail++;
+        return -W5X00_EINVAL;
+    }
+    w5x00_pipe_tx_reclaim(w5x00_pipe_tx.tail);
+    w5x00_pipe_slot_t *slot = w5x00_pipe_ring_free(&w5x00_pipe_tx);
+    if (!slot) {
+        // Core 1 is behind, and releases a slot as soon as it has written its frame to the chip
+        self->stats.tx_fail++;
+        return -W5X00_EAGAIN;
+    }
+    #if W5X00_LWIP
+    if (is_pbuf) {
+        // Hold on to the chain rather than copying it, core 1 writes it to the chip
+        pbuf_ref((struct pbuf *)buf);
+        slot->pbuf = buf;
+    } else
+    #endif
+    {
+        (void)is_pbuf;
+        memcpy(slot->data, buf, len);
+        self->stats.copy_bytes += len;
+    }
+    slot->len = (uint16_t)len;
+    w5x00_pipe_ring_publish(&w5x00_pipe_tx);
+    return 0;
+}
+
+// Passes the frames core 1 has received to lwIP, and does what core 1 can't
+static void w5x00_pipe_poll_func(w5x00_t *self) {
+    W5X00_THREAD_LOCK_CHECK;
+
+    if (self->poll == NULL) {
+        // Poll scheduled during deinit, just ignore it
+        return;
+    }
+
+    w5x00_t *prev_active = w5x00_activate(self);
+    self->stats.polls++;
+
+    if (w5x00_pipe_link_lost) {
+        w5x00_pipe_link_lost = false;
+        w5x00_cb_tcpip_set_link_down(self);
+    }
+    if (w5x00_pipe_sn_pending) {
+        uint8_t sn_ir[_WIZCHIP_SOCK_NUM_];
+        w5x00_bus_enter();
+        w5x00_sn_interrupts(w5x00_get_socket_interrupts(), sn_ir);
+        w5x00_bus_exit();
+        // Cleared, so core 1 can take INTn again
+        w5x00_pipe_sn_pending = false;
+        __sev();
+        // The handlers call back into the application, which may use the bus or wait on core 1
+        w5x00_sn_dispatch(self, sn_ir);
+    }
+    w5x00_pipe_tx_reclaim(w5x00_pipe_tx.tail);
+
+    uint frames = 0;
+    w5x00_pipe_slot_t *slot;
+    while (frames < self->rx_budget_frames && (slot = w5x00_pipe_ring_peek(&w5x00_pipe_rx)) != NULL) {
+        self->rx_src = slot->data + 2;
+        self->rx_len = slot->len;
+        self->rx_prio = slot->prio;
+        self->rx_start_us = slot->start_us;
+        w5x00_rx_latency_record(self);
+        w5x00_cb_process_ethernet(self, slot->len);
+        self->rx_len = 0;
+        self->rx_src = NULL;
+        w5x00_pipe_ring_release(&w5x00_pipe_rx);
+        frames++;
+    }
+    if (frames) {
+        w5x00_cb_rx_batch_done(self);
+    }
+    if (w5x00_pipe_ring_peek(&w5x00_pipe_rx)) {
+        w5x00_schedule_internal_poll_dispatch(self);
+    }
+
+    #if W5X00_LWIP && LWIP_IPV4
+    // Give core 1 the address the frames above may have brought, for w5x00_bcast_essential
+    if (self->pipe_ip4_addr != netif_ip4_addr(&self->netif)->addr) {
+        w5x00_bus_enter();
+        self->pipe_ip4_addr = netif_ip4_addr(&self->netif)->addr;
+        w5x00_bus_exit();
+    }
+    #endif
+
+    w5x00_activate(prev_active);
+}
+#endif
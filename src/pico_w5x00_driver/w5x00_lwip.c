@@ -2,11 +2,14 @@
 #include <string.h>
 
 #include "w5x00.h"
+#include "w5x00_trace.h"
+#include "w5x00_capture.h"
 #if W5X00_LWIP
 #include "lwip/etharp.h"
 #include "lwip/ethip6.h"
 #include "lwip/dns.h"
 #include "lwip/igmp.h"
+#include "lwip/snmp.h"
 #include "lwip/tcpip.h"
 #include "netif/ethernet.h"
 #endif
@@ -19,45 +22,52 @@
 
 STATIC err_t w5x00_netif_output(struct netif *netif, struct pbuf *p) {
     w5x00_t *self = netif->state;
-    pbuf_copy_partial(p, self->eth_frame, p->tot_len, 0);
-    int ret = w5x00_send_ethernet(self, p->tot_len, self->eth_frame, true);
+    int ret = w5x00_send_ethernet(self, p->tot_len, p, true);
+    if (ret == -W5X00_EAGAIN) {
+        // No room to queue it just now
+        MIB2_STATS_NETIF_INC(netif, ifoutdiscards);
+        return ERR_MEM;
+    }
     if (ret) {
         W5X00_WARN("send_ethernet failed: %d\n", ret);
+        MIB2_STATS_NETIF_INC(netif, ifoutdiscards);
+        return ERR_IF;
+    }
+    MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
+    if (((const uint8_t *)p->payload)[0] & 1) {
+        MIB2_STATS_NETIF_INC(netif, ifoutnucastpkts);
+    } else {
+        MIB2_STATS_NETIF_INC(netif, ifoutucastpkts);
+    }
+    return ERR_OK;
+}
+
+#if LWIP_IPV4 && LWIP_IGMP
+STATIC err_t w5x00_netif_update_igmp_mac_filter(struct netif *netif, const ip4_addr_t *group, enum netif_mac_filter_action action) {
+    uint8_t mac[] = { 0x01, 0x00, 0x5e, ip4_addr2(group) & 0x7F, ip4_addr3(group), ip4_addr4(group) };
+    if (action != NETIF_ADD_MAC_FILTER && action != NETIF_DEL_MAC_FILTER) {
+        return ERR_VAL;
+    }
+    if (w5x00_ethernet_update_multicast_filter(netif->state, mac, action == NETIF_ADD_MAC_FILTER)) {
         return ERR_IF;
     }
     return ERR_OK;
 }
+#endif
 
-// #if LWIP_IGMP
-// STATIC err_t w5x00_netif_update_igmp_mac_filter(struct netif *netif, const ip4_addr_t *group, enum netif_mac_filter_action action) {
-//     w5x00_t *self = netif->state;
-//     uint8_t mac[] = { 0x01, 0x00, 0x5e, ip4_addr2(group) & 0x7F, ip4_addr3(group), ip4_addr4(group) };
-
-//     if (action != IGMP_ADD_MAC_FILTER && action != IGMP_DEL_MAC_FILTER) {
-//         return ERR_VAL;
-//     }
-
-//     if (w5x00_ethernet_update_multicast_filter(self, mac, action == IGMP_ADD_MAC_FILTER)) {
-//         return ERR_IF;
-//     }
-
-//     return ERR_OK;
-// }
-// #endif
-
-// #if LWIP_IPV6
-// STATIC err_t w5x00_macfilter(struct netif *netif, const ip6_addr_t *group, enum netif_mac_filter_action action) {
-//     uint8_t address[6] = { 0x33, 0x33 };
-//     memcpy(address + 2, group->addr + 3, 4);
-//     if (action != NETIF_ADD_MAC_FILTER && action != NETIF_DEL_MAC_FILTER) {
-//         return ERR_VAL;
-//     }
-//     if (w5x00_ethernet_update_multicast_filter(netif->state, address, action == NETIF_ADD_MAC_FILTER)) {
-//         return ERR_IF;
-//     }
-//     return ERR_OK;
-// }
-// #endif
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+STATIC err_t w5x00_netif_update_mld_mac_filter(struct netif *netif, const ip6_addr_t *group, enum netif_mac_filter_action action) {
+    uint8_t mac[6] = { 0x33, 0x33 };
+    memcpy(mac + 2, &group->addr[3], 4);
+    if (action != NETIF_ADD_MAC_FILTER && action != NETIF_DEL_MAC_FILTER) {
+        return ERR_VAL;
+    }
+    if (w5x00_ethernet_update_multicast_filter(netif->state, mac, action == NETIF_ADD_MAC_FILTER)) {
+        return ERR_IF;
+    }
+    return ERR_OK;
+}
+#endif
 
 STATIC err_t w5x00_netif_init(struct netif *netif) {
     netif->linkoutput = w5x00_netif_output;
@@ -68,30 +78,35 @@ STATIC err_t w5x00_netif_init(struct netif *netif) {
     netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET | NETIF_FLAG_IGMP;
     #if LWIP_IPV6
     netif->output_ip6 = ethip6_output;
-    netif->mld_mac_filter = w5x00_macfilter;
+    #if LWIP_IPV6_MLD
+    netif_set_mld_mac_filter(netif, w5x00_netif_update_mld_mac_filter);
     netif->flags |= NETIF_FLAG_MLD6;
     #endif
+    #endif
     w5x00_ethernet_get_mac(netif->state, netif->hwaddr);
     netif->hwaddr_len = sizeof(netif->hwaddr);
-    // #if LWIP_IGMP
-    // netif_set_igmp_mac_filter(netif, w5x00_netif_update_igmp_mac_filter);
-    // #endif
+    #if LWIP_IPV4 && LWIP_IGMP
+    netif_set_igmp_mac_filter(netif, w5x00_netif_update_igmp_mac_filter);
+    #endif
 
     int ret = WIZCHIP_EXPORT(socket)(0, Sn_MR_MACRAW, 0, 0);
     if (ret != 0) {
         // printf("WIZNET fatal error in netifinit: %d\n", ret);
         return ERR_IF;
     }
+    // OPEN resets the TX pointers
+    ((w5x00_t *)netif->state)->tx_synced = false;
 
     // Enable MAC filtering so we only get frames destined for us, to reduce load on lwIP
-    setSn_MR(0, getSn_MR(0) | Sn_MR_MFEN);
+    if (!((w5x00_t *)netif->state)->promiscuous) {
+        setSn_MR(0, getSn_MR(0) | Sn_MR_MFEN);
+    }
     // Enable IPv6 packet Blocking bit in MACRAW mode
     setSn_MR2(0, getSn_MR2(0) | Sn_MR2_IPV6BLK);
-    // Enable Multicast Blocking bit in MACRAW mode
-    // Note may need to turn this off if using MDNS Responder LWIP_MDNS_RESPONDER (but is OK for just MDNS queries)
-    setSn_MR2(0, getSn_MR2(0) | Sn_MR2_MMBLK);
-    // Enable Broadcast Blocking bit in MACRAW mode
-    setSn_MR2(0, getSn_MR2(0) | Sn_MR2_MBBLK);
+    // Let multicast through, the driver drops frames for groups lwIP hasn't joined before a pbuf is allocated
+    setSn_MR2(0, getSn_MR2(0) & ~Sn_MR2_MMBLK);
+    // Let broadcasts through, the driver rate limits them other than ARP for us and DHCP
+    setSn_MR2(0, getSn_MR2(0) & ~Sn_MR2_MBBLK);
 
     return ERR_OK;
 }
@@ -132,7 +147,7 @@ void w5x00_cb_tcpip_init(w5x00_t *self) {
 
     struct netif *n = &self->netif;
     n->name[0] = 'e';
-    n->name[1] = '0';
+    n->name[1] = (char)('0' + self->idx);
     #if NO_SYS
     netif_input_fn input_func = ethernet_input;
     #else
@@ -146,7 +161,9 @@ void w5x00_cb_tcpip_init(w5x00_t *self) {
     #error Unsupported
     #endif
     netif_set_hostname(n, W5X00_HOST_NAME);
-    netif_set_default(n);
+    if (self == &w5x00_state) {
+        netif_set_default(n);
+    }
     netif_set_up(n);
 
 //    #ifndef NDEBUG
@@ -155,7 +172,9 @@ void w5x00_cb_tcpip_init(w5x00_t *self) {
 
     #if LWIP_IPV4
     #if LWIP_DNS
-    dns_setserver(0, &ipconfig[3]);
+    if (self == &w5x00_state) {
+        dns_setserver(0, &ipconfig[3]);
+    }
     #endif
     #if LWIP_DHCP
     dhcp_set_struct(n, &self->dhcp_client);
@@ -165,7 +184,9 @@ void w5x00_cb_tcpip_init(w5x00_t *self) {
     #if LWIP_IPV6
     ip6_addr_t ip6_allnodes_ll;
     ip6_addr_set_allnodes_linklocal(&ip6_allnodes_ll);
+    #if LWIP_IPV6_MLD
     n->mld_mac_filter(n, &ip6_allnodes_ll, NETIF_ADD_MAC_FILTER);
+    #endif
     netif_create_ip6_linklocal_address(n, 1);
     netif_set_ip6_autoconfig_enabled(n, 1);
     #endif
@@ -173,6 +194,11 @@ void w5x00_cb_tcpip_init(w5x00_t *self) {
 
 void w5x00_cb_tcpip_deinit(w5x00_t *self) {
     struct netif *n = &self->netif;
+    // Bulk frames held back for the end of a batch that never came
+    for (uint i = 0; i < self->rx_bulk_count; i++) {
+        pbuf_free(self->rx_bulk[i]);
+    }
+    self->rx_bulk_count = 0;
     #if LWIP_IPV4 && LWIP_DHCP
     dhcp_stop(n);
     #endif
@@ -187,16 +213,71 @@ void w5x00_cb_tcpip_deinit(w5x00_t *self) {
     }
 }
 
-void w5x00_cb_process_ethernet(void *cb_data, size_t len, const uint8_t *buf) {
+static void w5x00_netif_input(w5x00_t *self, struct pbuf *p, uint8_t prio) {
+    w5x00_rx_prio_stats_t *stats = &self->stats.rx_prio[prio];
+    uint32_t latency_us = time_us_32() - self->rx_start_us;
+    if (latency_us > stats->latency_max_us) {
+        stats->latency_max_us = latency_us;
+    }
+    W5X00_TRACE_EVENT(W5X00_TRACE_NETIF_INPUT, p->tot_len);
+    if (self->netif.input(p, &self->netif) != ERR_OK) {
+        self->stats.rx_input_fail++;
+        stats->drops++;
+        pbuf_free(p);
+    } else {
+        stats->frames++;
+    }
+}
+
+void w5x00_cb_rx_batch_done(w5x00_t *self) {
+    for (uint i = 0; i < self->rx_bulk_count; i++) {
+        w5x00_netif_input(self, self->rx_bulk[i], W5X00_RX_PRIO_BULK);
+    }
+    self->rx_bulk_count = 0;
+}
+
+void w5x00_cb_process_ethernet(void *cb_data, size_t len) {
     w5x00_t *self = cb_data;
     struct netif *netif = &self->netif;
+    uint8_t prio = self->rx_prio < W5X00_RX_PRIO_CLASSES ? self->rx_prio : W5X00_RX_PRIO_HIGH;
     if (netif->flags & NETIF_FLAG_LINK_UP) {
         struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
         if (p != NULL) {
-            pbuf_take(p, buf, len);
-            if (netif->input(p, netif) != ERR_OK) {
+            // Read the frame from the chip straight into the pbuf chain, holding the bus over the
+            // whole chain rather than taking it for each pbuf
+            uint16_t offset = 0;
+            w5x00_bus_enter();
+            for (struct pbuf *q = p; q != NULL; q = q->next) {
+                w5x00_read_ethernet(self, offset, q->payload, q->len);
+                offset += q->len;
+            }
+            w5x00_bus_exit();
+            w5x00_capture_tap(self, W5X00_CAPTURE_RX, p);
+            if (self->promiscuous && !(((const uint8_t *)p->payload)[0] & 1) &&
+                    memcmp(p->payload, netif->hwaddr, ETH_HWADDR_LEN) != 0) {
+                // Only let in for the capture, it's not for lwIP
                 pbuf_free(p);
+                return;
+            }
+            MIB2_STATS_NETIF_ADD(netif, ifinoctets, len);
+            if (((const uint8_t *)p->payload)[0] & 1) {
+                MIB2_STATS_NETIF_INC(netif, ifinnucastpkts);
+            } else {
+                MIB2_STATS_NETIF_INC(netif, ifinucastpkts);
             }
+            if (self->rx_prio_used && prio == W5X00_RX_PRIO_BULK) {
+                // Hold bulk frames back until the end of the batch, so high priority frames go first
+                if (self->rx_bulk_count == W5X00_RX_BULK_QUEUE_LEN) {
+                    w5x00_cb_rx_batch_done(self);
+                }
+                self->rx_bulk[self->rx_bulk_count++] = p;
+            } else {
+                w5x00_netif_input(self, p, prio);
+            }
+        } else {
+            self->stats.rx_pbuf_fail++;
+            self->stats.rx_prio[prio].drops++;
+            MIB2_STATS_NETIF_INC(netif, ifindiscards);
         }
     }
 }
@@ -7,15 +7,19 @@
 #include "hardware/spi.h"
 #include "hardware/dma.h"
 #include "w5x00.h"
+#include "w5x00_trace.h"
+
+// The ioLibrary callbacks below have no parameter for the chip, so they act on w5x00_active
 
 void w5x00_cs_select(void)
 {
-    w5x00_hal_pin_low(W5X00_SPI_CSN_PIN);
+    w5x00_hal_pin_low(w5x00_active->hw.csn_pin);
+    w5x00_active->stats.spi_transactions++;
 }
 
 void w5x00_cs_deselect(void)
 {
-    w5x00_hal_pin_high(W5X00_SPI_CSN_PIN);
+    w5x00_hal_pin_high(w5x00_active->hw.csn_pin);
 }
 
 uint8_t w5x00_spi_read(void)
@@ -23,86 +27,89 @@ uint8_t w5x00_spi_read(void)
     uint8_t rx_data = 0;
     uint8_t tx_data = 0xFF;
 
-    spi_read_blocking(W5X00_SPI_PORT, tx_data, &rx_data, 1);
+    spi_read_blocking(w5x00_active->hw.spi, tx_data, &rx_data, 1);
+    w5x00_active->stats.spi_bytes++;
 
     return rx_data;
 }
 
 void w5x00_spi_write(uint8_t tx_data)
 {
-    spi_write_blocking(W5X00_SPI_PORT, &tx_data, 1);
+    spi_write_blocking(w5x00_active->hw.spi, &tx_data, 1);
+    w5x00_active->stats.spi_bytes++;
 }
 
-void w5x00_spi_read_burst(uint8_t *pBuf, uint16_t len)
+// The DMA reads/writes these when there's no real data to send/receive
+static const uint8_t w5x00_spi_dummy_tx = 0xFF;
+static uint8_t w5x00_spi_dummy_rx;
+
+static void w5x00_spi_start_burst(w5x00_t *self, uint8_t *rx_buf, const uint8_t *tx_buf, uint16_t len)
 {
-    uint8_t dummy_data = 0xFF;
+    assert(!dma_channel_is_busy(self->dma_rx));
 
-    channel_config_set_read_increment(&w5x00_state.dma_channel_config_tx, false);
-    channel_config_set_write_increment(&w5x00_state.dma_channel_config_tx, false);
-    dma_channel_configure(w5x00_state.dma_tx, &w5x00_state.dma_channel_config_tx,
-                          &spi_get_hw(W5X00_SPI_PORT)->dr, // write address
-                          &dummy_data,               // read address
+    channel_config_set_read_increment(&self->dma_channel_config_tx, tx_buf != NULL);
+    channel_config_set_write_increment(&self->dma_channel_config_tx, false);
+    dma_channel_configure(self->dma_tx, &self->dma_channel_config_tx,
+                          &spi_get_hw(self->hw.spi)->dr, // write address
+                          tx_buf ? tx_buf : &w5x00_spi_dummy_tx, // read address
                           len,                       // element count (each element is of size transfer_data_size)
                           false);                    // don't start yet
 
-    channel_config_set_read_increment(&w5x00_state.dma_channel_config_rx, false);
-    channel_config_set_write_increment(&w5x00_state.dma_channel_config_rx, true);
-    dma_channel_configure(w5x00_state.dma_rx, &w5x00_state.dma_channel_config_rx,
-                          pBuf,                      // write address
-                          &spi_get_hw(W5X00_SPI_PORT)->dr, // read address
+    channel_config_set_read_increment(&self->dma_channel_config_rx, false);
+    channel_config_set_write_increment(&self->dma_channel_config_rx, rx_buf != NULL);
+    dma_channel_configure(self->dma_rx, &self->dma_channel_config_rx,
+                          rx_buf ? rx_buf : &w5x00_spi_dummy_rx, // write address
+                          &spi_get_hw(self->hw.spi)->dr, // read address
                           len,                       // element count (each element is of size transfer_data_size)
                           false);                    // don't start yet
 
-    dma_start_channel_mask((1u << w5x00_state.dma_tx) | (1u << w5x00_state.dma_rx));
-    // dma_channel_wait_for_finish_blocking(w5x00_state.dma_rx);
-    while(dma_channel_is_busy(w5x00_state.dma_rx)) {
-      w5x00_delay_ms(1);
-    }
+    dma_start_channel_mask((1u << self->dma_tx) | (1u << self->dma_rx));
+    self->stats.dma_transfers++;
+    self->stats.spi_bytes += len;
 }
 
-void w5x00_spi_write_burst(const uint8_t *pBuf, uint16_t len)
+static void w5x00_spi_wait_burst(w5x00_t *self, __unused uint16_t len)
 {
-    uint8_t dummy_data;
-
-    channel_config_set_read_increment(&w5x00_state.dma_channel_config_tx, true);
-    channel_config_set_write_increment(&w5x00_state.dma_channel_config_tx, false);
-    dma_channel_configure(w5x00_state.dma_tx, &w5x00_state.dma_channel_config_tx,
-                          &spi_get_hw(W5X00_SPI_PORT)->dr, // write address
-                          pBuf,                      // read address
-                          len,                       // element count (each element is of size transfer_data_size)
-                          false);                    // don't start yet
+    // The rx channel finishes last, and its completion IRQ releases dma_done. Under FreeRTOS the
+    // task blocks on it so others can run, otherwise it's a __wfe(). A release left over from an
+    // earlier burst just goes round again
+    while (dma_channel_is_busy(self->dma_rx)) {
+        sem_acquire_blocking(&self->dma_done);
+    }
+    // On the same core as the SPI_BEGIN, whichever core takes the DMA IRQ
+    W5X00_TRACE_EVENT(W5X00_TRACE_SPI_END, len);
+}
 
-    channel_config_set_read_increment(&w5x00_state.dma_channel_config_rx, false);
-    channel_config_set_write_increment(&w5x00_state.dma_channel_config_rx, false);
-    dma_channel_configure(w5x00_state.dma_rx, &w5x00_state.dma_channel_config_rx,
-                          &dummy_data,               // write address
-                          &spi_get_hw(W5X00_SPI_PORT)->dr, // read address
-                          len,                       // element count (each element is of size transfer_data_size)
-                          false);                    // don't start yet
+void w5x00_spi_read_burst(uint8_t *pBuf, uint16_t len)
+{
+    W5X00_TRACE_EVENT(W5X00_TRACE_SPI_BEGIN, len);
+    w5x00_spi_start_burst(w5x00_active, pBuf, NULL, len);
+    w5x00_spi_wait_burst(w5x00_active, len);
+}
 
-    dma_start_channel_mask((1u << w5x00_state.dma_tx) | (1u << w5x00_state.dma_rx));
-    // dma_channel_wait_for_finish_blocking(w5x00_state.dma_rx);
-    while(dma_channel_is_busy(w5x00_state.dma_rx)) {
-      w5x00_delay_ms(1);
-    }
+void w5x00_spi_write_burst(const uint8_t *pBuf, uint16_t len)
+{
+    W5X00_TRACE_EVENT(W5X00_TRACE_SPI_BEGIN, len);
+    w5x00_spi_start_burst(w5x00_active, NULL, pBuf, len);
+    w5x00_spi_wait_burst(w5x00_active, len);
 }
 
 int w5x00_spi_init(w5x00_t *self)
 {
-    // this example will use SPI0 at 5MHz
-    spi_init(W5X00_SPI_PORT, 5000 * 1000);
+    // start slow, w5x00_ensure_up calibrates the clock once the chip is accessible
+    self->spi_baudrate = spi_init(self->hw.spi, W5X00_SPI_BAUD_INIT);
 
-    gpio_set_function(W5X00_SPI_SCK_PIN, GPIO_FUNC_SPI);
-    gpio_set_function(W5X00_SPI_MOSI_PIN, GPIO_FUNC_SPI);
-    gpio_set_function(W5X00_SPI_MISO_PIN, GPIO_FUNC_SPI);
+    gpio_set_function(self->hw.sck_pin, GPIO_FUNC_SPI);
+    gpio_set_function(self->hw.mosi_pin, GPIO_FUNC_SPI);
+    gpio_set_function(self->hw.miso_pin, GPIO_FUNC_SPI);
 
     // make the SPI pins available to picotool
     // bi_decl(bi_3pins_with_func(W5X00_SPI_MISO_PIN, W5X00_SPI_MOSI_PIN, W5X00_SPI_SCK_PIN, GPIO_FUNC_SPI));
 
     // chip select is active-low, so we'll initialise it to a driven-high state
-    gpio_init(W5X00_SPI_CSN_PIN);
-    w5x00_hal_pin_config(W5X00_SPI_CSN_PIN, W5X00_HAL_PIN_MODE_OUTPUT, W5X00_HAL_PIN_PULL_NONE, 0);
-    w5x00_hal_pin_high(W5X00_SPI_CSN_PIN);
+    gpio_init(self->hw.csn_pin);
+    w5x00_hal_pin_config(self->hw.csn_pin, W5X00_HAL_PIN_MODE_OUTPUT, W5X00_HAL_PIN_PULL_NONE, 0);
+    w5x00_hal_pin_high(self->hw.csn_pin);
 
     // make the SPI pins available to picotool
     // bi_decl(bi_1pin_with_name(W5X00_SPI_CSN_PIN, "W5x00 CHIP SELECT"));
@@ -119,20 +126,39 @@ int w5x00_spi_init(w5x00_t *self)
 
     self->dma_channel_config_tx = dma_channel_get_default_config(self->dma_tx);
     channel_config_set_transfer_data_size(&self->dma_channel_config_tx, DMA_SIZE_8);
-    channel_config_set_dreq(&self->dma_channel_config_tx, DREQ_SPI0_TX);
+    bool on_spi1 = spi_get_index(self->hw.spi) != 0;
+    channel_config_set_dreq(&self->dma_channel_config_tx, on_spi1 ? DREQ_SPI1_TX : DREQ_SPI0_TX);
 
     // We set the inbound DMA to transfer from the SPI receive FIFO to a memory buffer paced by the SPI RX FIFO DREQ
     // We configure the read address to remain unchanged for each element, but the write
     // address to increment (so data is written throughout the buffer)
     self->dma_channel_config_rx = dma_channel_get_default_config(self->dma_rx);
     channel_config_set_transfer_data_size(&self->dma_channel_config_rx, DMA_SIZE_8);
-    channel_config_set_dreq(&self->dma_channel_config_rx, DREQ_SPI0_RX);
+    channel_config_set_dreq(&self->dma_channel_config_rx, on_spi1 ? DREQ_SPI1_RX : DREQ_SPI0_RX);
     channel_config_set_read_increment(&self->dma_channel_config_rx, false);
     channel_config_set_write_increment(&self->dma_channel_config_rx, true);
 
+    // Completion of the rx channel signals the end of a burst, see w5x00_dma_irq_handler
+    sem_init(&self->dma_done, 0, 1);
+    dma_irqn_set_channel_enabled(W5X00_DMA_IRQ_NUM, self->dma_rx, true);
+
     return 0;
 }
 
+uint w5x00_spi_set_baudrate(w5x00_t *self, uint baudrate)
+{
+    if (baudrate > W5X00_SPI_BAUD_MAX) {
+        baudrate = W5X00_SPI_BAUD_MAX;
+    }
+    self->spi_baudrate = spi_set_baudrate(self->hw.spi, baudrate);
+    return self->spi_baudrate;
+}
+
+uint w5x00_spi_get_baudrate(w5x00_t *self)
+{
+    return self->spi_baudrate;
+}
+
 void w5x00_spi_deinit(w5x00_t *self)
 {
     if (self->dma_tx >= 0) {
@@ -141,6 +167,7 @@ void w5x00_spi_deinit(w5x00_t *self)
         self->dma_tx = -1;
     }
     if (self->dma_rx >= 0) {
+        dma_irqn_set_channel_enabled(W5X00_DMA_IRQ_NUM, self->dma_rx, false);
         dma_channel_cleanup(self->dma_rx);
         dma_channel_unclaim(self->dma_rx);
         self->dma_rx = -1;
@@ -0,0 +1,165 @@
+#include "w5x00.h"
+#include "w5x00_tcp.h"
+
+#include "wizchip_conf.h"
+#include "socket.h"
+
+static void w5x00_tcp_commit(w5x00_tcp_t *tcp) {
+    setSn_TX_WR(tcp->sn, tcp->tx_ptr);
+    tcp->tx_wr = tcp->tx_ptr;
+    setSn_CR(tcp->sn, Sn_CR_SEND);
+    while (getSn_CR(tcp->sn));
+    tcp->send_busy = true;
+}
+
+static void w5x00_tcp_handler(__unused w5x00_t *self, __unused uint8_t sn, uint8_t ir, void *param) {
+    w5x00_tcp_t *tcp = param;
+    uint8_t events = 0;
+    w5x00_bus_enter();
+    if (ir & Sn_IR_CON) {
+        // Fresh connection, so fresh TX pointers
+        tcp->tx_ptr = tcp->tx_wr = getSn_TX_WR(tcp->sn);
+        tcp->send_busy = false;
+        events |= W5X00_TCP_EVENT_CONNECTED;
+    }
+    if (ir & Sn_IR_SENDOK) {
+        tcp->send_busy = false;
+        if (tcp->tx_ptr != tcp->tx_wr) {
+            // Data was written while the last SEND was in progress
+            w5x00_tcp_commit(tcp);
+        }
+        events |= W5X00_TCP_EVENT_SENT;
+    }
+    if (ir & Sn_IR_RECV) {
+        events |= W5X00_TCP_EVENT_RECV;
+    }
+    if (ir & Sn_IR_DISCON) {
+        events |= W5X00_TCP_EVENT_CLOSED;
+    }
+    if (ir & Sn_IR_TIMEOUT) {
+        tcp->send_busy = false;
+        events |= W5X00_TCP_EVENT_ERROR;
+    }
+    w5x00_bus_exit();
+    // With the bus let go, as the callback is free to call back into this API or into lwIP
+    if (events && tcp->event_cb) {
+        tcp->event_cb(tcp, events, tcp->arg);
+    }
+}
+
+int w5x00_tcp_open(w5x00_t *self, w5x00_tcp_t *tcp, uint16_t local_port, w5x00_tcp_event_cb_t event_cb, void *arg) {
+    w5x00_t *prev_active = W5X00_ENTER(self);
+    memset(tcp, 0, sizeof(*tcp));
+    tcp->w5x00 = self;
+    tcp->event_cb = event_cb;
+    tcp->arg = arg;
+    // Not with the bus held, it may have to bring the chip up
+    int sn = w5x00_socket_alloc(self, w5x00_tcp_handler, tcp);
+    if (sn < 0) {
+        tcp->sn = -1;
+        W5X00_EXIT(prev_active);
+        return sn;
+    }
+    tcp->sn = (int8_t)sn;
+    w5x00_bus_enter();
+    bool ok = WIZCHIP_EXPORT(socket)((uint8_t)sn, Sn_MR_TCP, local_port, SF_IO_NONBLOCK) == sn;
+    if (ok) {
+        setSn_IMR((uint8_t)sn, Sn_IR_CON | Sn_IR_DISCON | Sn_IR_RECV | Sn_IR_TIMEOUT | Sn_IR_SENDOK);
+    }
+    w5x00_bus_exit();
+    if (!ok) {
+        w5x00_socket_free(self, (uint8_t)sn);
+        tcp->sn = -1;
+    }
+    W5X00_EXIT(prev_active);
+    return ok ? 0 : -W5X00_EIO;
+}
+
+int w5x00_tcp_connect(w5x00_tcp_t *tcp, const uint8_t ip[4], uint16_t port) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(tcp->w5x00);
+    int ret = WIZCHIP_EXPORT(connect)((uint8_t)tcp->sn, (uint8_t *)ip, port);
+    W5X00_BUS_EXIT(prev_active);
+    // in non-blocking mode SOCK_BUSY means the connect is under way
+    return (ret == SOCK_OK || ret == SOCK_BUSY) ? 0 : -W5X00_EIO;
+}
+
+int w5x00_tcp_listen(w5x00_tcp_t *tcp) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(tcp->w5x00);
+    int ret = WIZCHIP_EXPORT(listen)((uint8_t)tcp->sn);
+    W5X00_BUS_EXIT(prev_active);
+    return ret == SOCK_OK ? 0 : -W5X00_EIO;
+}
+
+int w5x00_tcp_send(w5x00_tcp_t *tcp, const void *buf, size_t len) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(tcp->w5x00);
+    uint8_t sn = (uint8_t)tcp->sn;
+    uint8_t sr = getSn_SR(sn);
+    if (sr != SOCK_ESTABLISHED && sr != SOCK_CLOSE_WAIT) {
+        W5X00_BUS_EXIT(prev_active);
+        return -W5X00_EPERM;
+    }
+    // Free space as seen by the chip, less what we've written but not yet committed
+    uint16_t avail = getSn_TX_FSR(sn) - (uint16_t)(tcp->tx_ptr - tcp->tx_wr);
+    if (len > avail) {
+        len = avail;
+    }
+    if (len) {
+        // Straight from the caller's buffer into the TX ring. If a SEND is in progress the
+        // data is sent along with anything else written when it completes
+        w5x00_sn_write_tx(tcp->w5x00, sn, tcp->tx_ptr, buf, (uint16_t)len);
+        tcp->tx_ptr += len;
+        if (!tcp->send_busy) {
+            w5x00_tcp_commit(tcp);
+        }
+    }
+    W5X00_BUS_EXIT(prev_active);
+    return (int)len;
+}
+
+int w5x00_tcp_recv(w5x00_tcp_t *tcp, void *buf, size_t len) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(tcp->w5x00);
+    uint8_t sn = (uint8_t)tcp->sn;
+    uint16_t rsr = getSn_RX_RSR(sn);
+    if (rsr == 0) {
+        uint8_t sr = getSn_SR(sn);
+        W5X00_BUS_EXIT(prev_active);
+        return (sr == SOCK_ESTABLISHED) ? 0 : -W5X00_EPERM;
+    }
+    if (len > rsr) {
+        len = rsr;
+    }
+    uint16_t rd = getSn_RX_RD(sn);
+    w5x00_sn_read_rx(tcp->w5x00, sn, rd, buf, (uint16_t)len);
+    setSn_RX_RD(sn, rd + len);
+    setSn_CR(sn, Sn_CR_RECV);
+    while (getSn_CR(sn));
+    W5X00_BUS_EXIT(prev_active);
+    return (int)len;
+}
+
+size_t w5x00_tcp_recv_available(w5x00_tcp_t *tcp) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(tcp->w5x00);
+    size_t ret = getSn_RX_RSR((uint8_t)tcp->sn);
+    W5X00_BUS_EXIT(prev_active);
+    return ret;
+}
+
+int w5x00_tcp_shutdown(w5x00_tcp_t *tcp) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(tcp->w5x00);
+    setSn_CR((uint8_t)tcp->sn, Sn_CR_DISCON);
+    while (getSn_CR((uint8_t)tcp->sn));
+    W5X00_BUS_EXIT(prev_active);
+    return 0;
+}
+
+void w5x00_tcp_close(w5x00_tcp_t *tcp) {
+    if (tcp->sn < 0) {
+        return;
+    }
+    w5x00_t *prev_active = W5X00_BUS_ENTER(tcp->w5x00);
+    setSn_IMR((uint8_t)tcp->sn, 0);
+    WIZCHIP_EXPORT(close)((uint8_t)tcp->sn);
+    w5x00_socket_free(tcp->w5x00, (uint8_t)tcp->sn);
+    tcp->sn = -1;
+    W5X00_BUS_EXIT(prev_active);
+}
@@ -0,0 +1,52 @@
+#include "w5x00_trace.h"
+
+#if W5X00_TRACE
+
+w5x00_trace_ring_t w5x00_trace_rings[NUM_CORES];
+
+void w5x00_trace_dump(void) {
+    // Snapshot where each ring starts and ends, entries recorded while dumping may be overwritten
+    uint32_t pos[NUM_CORES];
+    uint32_t end[NUM_CORES];
+    for (uint core = 0; core < NUM_CORES; core++) {
+        end[core] = w5x00_trace_rings[core].head;
+        pos[core] = end[core] > W5X00_TRACE_BUF_LEN ? end[core] - W5X00_TRACE_BUF_LEN : 0;
+    }
+    W5X00_PRINTF("W5X00 TRACE BEGIN\n");
+    for (;;) {
+        // merge the rings in time order
+        const w5x00_trace_entry_t *next = NULL;
+        uint next_core = 0;
+        for (uint core = 0; core < NUM_CORES; core++) {
+            if (pos[core] != end[core]) {
+                const w5x00_trace_entry_t *e = &w5x00_trace_rings[core].buf[pos[core] & (W5X00_TRACE_BUF_LEN - 1)];
+                if (!next || (int32_t)(e->time_us - next->time_us) < 0) {
+                    next = e;
+                    next_core = core;
+                }
+            }
+        }
+        if (!next) {
+            break;
+        }
+        W5X00_PRINTF("%lu %u %u %u\n", (unsigned long)next->time_us, next->core, next->event, next->arg);
+        pos[next_core]++;
+    }
+    W5X00_PRINTF("W5X00 TRACE END\n");
+}
+
+void w5x00_trace_clear(void) {
+    for (uint core = 0; core < NUM_CORES; core++) {
+        w5x00_trace_rings[core].head = 0;
+    }
+}
+
+#else
+
+void w5x00_trace_dump(void) {
+}
+
+void w5x00_trace_clear(void) {
+}
+
+#endif
@@ -0,0 +1,179 @@
+#include "w5x00.h"
+#include "w5x00_udp.h"
+
+#include "wizchip_conf.h"
+#include "socket.h"
+
+// In UDP mode each datagram in the RX ring is preceded by the source ip, port and length
+#define W5X00_UDP_RX_HEADER_LEN 8
+
+static void w5x00_udp_send(w5x00_udp_t *udp, const uint8_t ip[4], uint16_t port, uint16_t end) {
+    uint8_t sn = (uint8_t)udp->sn;
+    // Most streams go to a single collector, so avoid rewriting the destination
+    if (memcmp(udp->dest_ip, ip, 4) != 0) {
+        memcpy(udp->dest_ip, ip, 4);
+        setSn_DIPR(sn, udp->dest_ip);
+    }
+    if (udp->dest_port != port) {
+        udp->dest_port = port;
+        setSn_DPORT(sn, port);
+    }
+    setSn_TX_WR(sn, end);
+    udp->tx_wr = end;
+    setSn_CR(sn, Sn_CR_SEND);
+    while (getSn_CR(sn));
+    udp->send_busy = true;
+}
+
+static void w5x00_udp_handler(__unused w5x00_t *self, __unused uint8_t sn, uint8_t ir, void *param) {
+    w5x00_udp_t *udp = param;
+    uint8_t events = 0;
+    if (ir & (Sn_IR_SENDOK | Sn_IR_TIMEOUT)) {
+        udp->send_busy = false;
+        if (udp->send_pending) {
+            udp->send_pending = false;
+            w5x00_bus_enter();
+            w5x00_udp_send(udp, udp->pending_ip, udp->pending_port, udp->tx_end);
+            w5x00_bus_exit();
+        }
+        events |= (ir & Sn_IR_TIMEOUT) ? W5X00_UDP_EVENT_ERROR : W5X00_UDP_EVENT_SENT;
+    }
+    if (ir & Sn_IR_RECV) {
+        events |= W5X00_UDP_EVENT_RECV;
+    }
+    // Not with the bus held, as the callback is free to call back into this API or into lwIP
+    if (events && udp->event_cb) {
+        udp->event_cb(udp, events, udp->arg);
+    }
+}
+
+int w5x00_udp_open(w5x00_t *self, w5x00_udp_t *udp, uint16_t local_port, w5x00_udp_event_cb_t event_cb, void *arg) {
+    w5x00_t *prev_active = W5X00_ENTER(self);
+    memset(udp, 0, sizeof(*udp));
+    udp->w5x00 = self;
+    udp->event_cb = event_cb;
+    udp->arg = arg;
+    // Not with the bus held, it may have to bring the chip up
+    int sn = w5x00_socket_alloc(self, w5x00_udp_handler, udp);
+    if (sn < 0) {
+        udp->sn = -1;
+        W5X00_EXIT(prev_active);
+        return sn;
+    }
+    udp->sn = (int8_t)sn;
+    w5x00_bus_enter();
+    bool ok = WIZCHIP_EXPORT(socket)((uint8_t)sn, Sn_MR_UDP, local_port, SF_IO_NONBLOCK) == sn;
+    if (ok) {
+        udp->tx_ptr = udp->tx_end = udp->tx_wr = getSn_TX_WR((uint8_t)sn);
+        setSn_IMR((uint8_t)sn, Sn_IR_RECV | Sn_IR_TIMEOUT | Sn_IR_SENDOK);
+    }
+    w5x00_bus_exit();
+    if (!ok) {
+        w5x00_socket_free(self, (uint8_t)sn);
+        udp->sn = -1;
+    }
+    W5X00_EXIT(prev_active);
+    return ok ? 0 : -W5X00_EIO;
+}
+
+void w5x00_udp_close(w5x00_udp_t *udp) {
+    if (udp->sn < 0) {
+        return;
+    }
+    w5x00_t *prev_active = W5X00_BUS_ENTER(udp->w5x00);
+    setSn_IMR((uint8_t)udp->sn, 0);
+    WIZCHIP_EXPORT(close)((uint8_t)udp->sn);
+    w5x00_socket_free(udp->w5x00, (uint8_t)udp->sn);
+    udp->sn = -1;
+    W5X00_BUS_EXIT(prev_active);
+}
+
+bool w5x00_udp_tx_reserve(w5x00_udp_t *udp, uint16_t len) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(udp->w5x00);
+    bool ok = false;
+    // Only one datagram can wait for the SEND in progress
+    if (!udp->send_pending) {
+        // Free space as seen by the chip, less the committed datagram that's waiting
+        uint16_t avail = getSn_TX_FSR((uint8_t)udp->sn) - (uint16_t)(udp->tx_end - udp->tx_wr);
+        if (len <= avail) {
+            udp->tx_ptr = udp->tx_end;
+            udp->tx_reserved = len;
+            ok = true;
+        }
+    }
+    W5X00_BUS_EXIT(prev_active);
+    return ok;
+}
+
+void w5x00_udp_tx_write(w5x00_udp_t *udp, uint16_t offset, const void *buf, uint16_t len) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(udp->w5x00);
+    assert(offset + len <= udp->tx_reserved);
+    w5x00_sn_write_tx(udp->w5x00, (uint8_t)udp->sn, udp->tx_ptr + offset, buf, len);
+    W5X00_BUS_EXIT(prev_active);
+}
+
+int w5x00_udp_tx_commit(w5x00_udp_t *udp, const uint8_t ip[4], uint16_t port) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(udp->w5x00);
+    if (!udp->tx_reserved) {
+        W5X00_BUS_EXIT(prev_active);
+        return -W5X00_EPERM;
+    }
+    udp->tx_end = udp->tx_ptr + udp->tx_reserved;
+    udp->tx_reserved = 0;
+    if (!udp->send_busy) {
+        w5x00_udp_send(udp, ip, port, udp->tx_end);
+    } else {
+        // sent by w5x00_udp_handler when the SEND in progress completes
+        memcpy(udp->pending_ip, ip, 4);
+        udp->pending_port = port;
+        udp->send_pending = true;
+    }
+    W5X00_BUS_EXIT(prev_active);
+    return 0;
+}
+
+bool w5x00_udp_rx_peek(w5x00_udp_t *udp, w5x00_udp_rx_view_t *view) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(udp->w5x00);
+    uint8_t sn = (uint8_t)udp->sn;
+    uint16_t rsr = getSn_RX_RSR(sn);
+    if (rsr < W5X00_UDP_RX_HEADER_LEN) {
+        W5X00_BUS_EXIT(prev_active);
+        return false;
+    }
+    uint8_t head[W5X00_UDP_RX_HEADER_LEN];
+    uint16_t rd = getSn_RX_RD(sn);
+    w5x00_sn_read_rx(udp->w5x00, sn, rd, head, sizeof(head));
+    uint16_t len = (uint16_t)((head[6] << 8) | head[7]);
+    if (len > rsr - W5X00_UDP_RX_HEADER_LEN) {
+        // The chip only counts a datagram once it's all in, so the ring is out of step. Drop what's
+        // there rather than hand out a view of data that was never received
+        setSn_RX_RD(sn, rd + rsr);
+        setSn_CR(sn, Sn_CR_RECV);
+        while (getSn_CR(sn));
+        udp->rx_errors++;
+        W5X00_BUS_EXIT(prev_active);
+        return false;
+    }
+    memcpy(view->ip, head, 4);
+    view->port = (uint16_t)((head[4] << 8) | head[5]);
+    view->len = len;
+    view->ptr = rd + W5X00_UDP_RX_HEADER_LEN;
+    W5X00_BUS_EXIT(prev_active);
+    return true;
+}
+
+void w5x00_udp_rx_read(w5x00_udp_t *udp, const w5x00_udp_rx_view_t *view, uint16_t offset, void *buf, uint16_t len) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(udp->w5x00);
+    assert(offset + len <= view->len);
+    w5x00_sn_read_rx(udp->w5x00, (uint8_t)udp->sn, view->ptr + offset, buf, len);
+    W5X00_BUS_EXIT(prev_active);
+}
+
+void w5x00_udp_rx_release(w5x00_udp_t *udp, const w5x00_udp_rx_view_t *view) {
+    w5x00_t *prev_active = W5X00_BUS_ENTER(udp->w5x00);
+    uint8_t sn = (uint8_t)udp->sn;
+    setSn_RX_RD(sn, view->ptr + view->len);
+    setSn_CR(sn, Sn_CR_RECV);
+    while (getSn_CR(sn));
+    W5X00_BUS_EXIT(prev_active);
+}
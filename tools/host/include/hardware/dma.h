@@ -0,0 +1,64 @@
+#ifndef W5X00_HOST_HARDWARE_DMA_H
+#define W5X00_HOST_HARDWARE_DMA_H
+
+#include "pico.h"
+
+#define NUM_DMA_CHANNELS 12
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2,
+};
+
+enum dreq_num {
+    DREQ_SPI0_TX = 16,
+    DREQ_SPI0_RX = 17,
+    DREQ_SPI1_TX = 18,
+    DREQ_SPI1_RX = 19,
+    DREQ_FORCE = 63,
+};
+
+typedef struct {
+    bool read_increment;
+    bool write_increment;
+    uint dreq;
+    enum dma_channel_transfer_size size;
+} dma_channel_config;
+
+// A transfer runs to completion as soon as it's started, and raises its IRQ straight away.
+// Only byte transfers between memory and an SPI data register are supported
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+void dma_channel_cleanup(uint channel);
+dma_channel_config dma_channel_get_default_config(uint channel);
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->size = size;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->dreq = dreq;
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->read_increment = incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->write_increment = incr;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_start_channel_mask(uint32_t chan_mask);
+
+static inline bool dma_channel_is_busy(__unused uint channel) {
+    return false;
+}
+
+void dma_irqn_set_channel_enabled(uint irq_index, uint channel, bool enabled);
+bool dma_irqn_get_channel_status(uint irq_index, uint channel);
+void dma_irqn_acknowledge_channel(uint irq_index, uint channel);
+
+#endif
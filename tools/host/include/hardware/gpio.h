@@ -0,0 +1,51 @@
+#ifndef W5X00_HOST_HARDWARE_GPIO_H
+#define W5X00_HOST_HARDWARE_GPIO_H
+
+#include "pico.h"
+
+#define NUM_BANK0_GPIOS 30
+
+enum gpio_dir {
+    GPIO_IN = 0,
+    GPIO_OUT = 1,
+};
+
+enum gpio_function {
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_NULL = 0x1f,
+};
+
+enum gpio_irq_level {
+    GPIO_IRQ_LEVEL_LOW = 0x1u,
+    GPIO_IRQ_LEVEL_HIGH = 0x2u,
+    GPIO_IRQ_EDGE_FALL = 0x4u,
+    GPIO_IRQ_EDGE_RISE = 0x8u,
+};
+
+typedef void (*irq_handler_t)(void);
+
+void gpio_init(uint gpio);
+void gpio_set_function(uint gpio, uint fn);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_set_pulls(uint gpio, bool up, bool down);
+bool gpio_get(uint gpio);
+void gpio_set_mask(uint32_t mask);
+void gpio_clr_mask(uint32_t mask);
+
+static inline void gpio_put(uint gpio, bool value) {
+    if (value) {
+        gpio_set_mask(1u << gpio);
+    } else {
+        gpio_clr_mask(1u << gpio);
+    }
+}
+
+// Only level interrupts are modelled, they are taken by w5x00_host_run
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled);
+uint32_t gpio_get_irq_event_mask(uint gpio);
+void gpio_acknowledge_irq(uint gpio, uint32_t event_mask);
+void gpio_add_raw_irq_handler_with_order_priority(uint gpio, irq_handler_t handler, uint8_t order_priority);
+void gpio_remove_raw_irq_handler(uint gpio, irq_handler_t handler);
+
+#endif
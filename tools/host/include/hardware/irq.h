@@ -0,0 +1,21 @@
+#ifndef W5X00_HOST_HARDWARE_IRQ_H
+#define W5X00_HOST_HARDWARE_IRQ_H
+
+#include "pico.h"
+#include "hardware/gpio.h"
+
+enum irq_num {
+    DMA_IRQ_0 = 11,
+    DMA_IRQ_1 = 12,
+    IO_IRQ_BANK0 = 13,
+    NUM_IRQS = 32,
+};
+
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+
+void irq_set_enabled(uint num, bool enabled);
+bool irq_is_enabled(uint num);
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority);
+void irq_remove_handler(uint num, irq_handler_t handler);
+
+#endif
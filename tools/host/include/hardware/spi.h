@@ -0,0 +1,41 @@
+#ifndef W5X00_HOST_HARDWARE_SPI_H
+#define W5X00_HOST_HARDWARE_SPI_H
+
+#include "pico.h"
+
+// The DMA moves bytes to and from dr, see hardware/dma.h
+typedef struct {
+    volatile uint32_t dr;
+} spi_hw_t;
+
+typedef struct spi_inst {
+    spi_hw_t hw;
+    uint index;
+    uint baudrate;
+} spi_inst_t;
+
+extern spi_inst_t w5x00_host_spi_inst[2];
+
+#define spi0 (&w5x00_host_spi_inst[0])
+#define spi1 (&w5x00_host_spi_inst[1])
+
+// The clock the SPI divides down, like clk_peri at its default
+#define W5X00_HOST_SPI_CLK_HZ (125 * 1000 * 1000)
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+void spi_deinit(spi_inst_t *spi);
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate);
+uint spi_get_baudrate(const spi_inst_t *spi);
+
+static inline uint spi_get_index(const spi_inst_t *spi) {
+    return spi->index;
+}
+
+static inline spi_hw_t *spi_get_hw(spi_inst_t *spi) {
+    return &spi->hw;
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef W5X00_HOST_HARDWARE_SYNC_H
+#define W5X00_HOST_HARDWARE_SYNC_H
+
+#include "pico.h"
+
+// Interrupts are only delivered between async_context workers, see w5x00_host_run
+static inline uint32_t save_and_disable_interrupts(void) {
+    return 0;
+}
+
+static inline void restore_interrupts(__unused uint32_t status) {
+}
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef W5X00_HOST_HARDWARE_TIMER_H
+#define W5X00_HOST_HARDWARE_TIMER_H
+
+#include "pico/time.h"
+
+#endif
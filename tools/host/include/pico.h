@@ -0,0 +1,67 @@
+#ifndef W5X00_HOST_PICO_H
+#define W5X00_HOST_PICO_H
+
+// Just enough of the pico-sdk for pico_w5x00_driver to build and run on a Linux host, see tools/host
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef unsigned int uint;
+
+#define __unused __attribute__((unused))
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+#define __not_in_flash_func(f) f
+#define __time_critical_func(f) f
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define NUM_CORES 2
+
+enum pico_error_codes {
+    PICO_OK = 0,
+    PICO_ERROR_NONE = 0,
+    PICO_ERROR_TIMEOUT = -1,
+    PICO_ERROR_GENERIC = -2,
+    PICO_ERROR_NO_DATA = -3,
+    PICO_ERROR_NOT_PERMITTED = -4,
+    PICO_ERROR_INVALID_ARG = -5,
+    PICO_ERROR_IO = -6,
+    PICO_ERROR_BADAUTH = -7,
+    PICO_ERROR_CONNECT_FAILED = -8,
+    PICO_ERROR_INSUFFICIENT_RESOURCES = -9,
+};
+
+void panic(const char *fmt, ...) __attribute__((noreturn));
+
+// Everything runs in thread mode, on "core 0" unless w5x00_host.c is running a core 1 pass
+extern uint w5x00_host_core_num;
+
+static inline uint get_core_num(void) {
+    return w5x00_host_core_num;
+}
+
+static inline uint __get_current_exception(void) {
+    return 0;
+}
+
+static inline void __sev(void) {
+}
+
+static inline void __wfe(void) {
+}
+
+static inline void __dmb(void) {
+}
+
+static inline void tight_loop_contents(void) {
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef W5X00_HOST_PICO_MUTEX_H
+#define W5X00_HOST_PICO_MUTEX_H
+
+#include "pico.h"
+
+// The cores take turns at whole passes, see w5x00_host_run, so a mutex is never found held by the
+// other core unless it was left held
+typedef struct {
+    bool owned;
+    uint owner;
+} mutex_t;
+
+#define auto_init_mutex(name) static mutex_t name
+
+static inline void mutex_enter_blocking(mutex_t *mtx) {
+    if (mtx->owned) {
+        panic("mutex held by core %u would block core %u for ever", mtx->owner, get_core_num());
+    }
+    mtx->owned = true;
+    mtx->owner = get_core_num();
+}
+
+static inline void mutex_exit(mutex_t *mtx) {
+    assert(mtx->owned && mtx->owner == get_core_num());
+    mtx->owned = false;
+}
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef W5X00_HOST_PICO_PLATFORM_H
+#define W5X00_HOST_PICO_PLATFORM_H
+
+#include "pico.h"
+
+#endif
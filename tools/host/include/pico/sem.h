@@ -0,0 +1,32 @@
+#ifndef W5X00_HOST_PICO_SEM_H
+#define W5X00_HOST_PICO_SEM_H
+
+#include "pico.h"
+
+// DMA completes before dma_start_channel_mask returns, so nothing ever waits on one of these
+typedef struct {
+    int16_t permits;
+    int16_t max_permits;
+} semaphore_t;
+
+static inline void sem_init(semaphore_t *sem, int16_t initial_permits, int16_t max_permits) {
+    sem->permits = initial_permits;
+    sem->max_permits = max_permits;
+}
+
+static inline bool sem_release(semaphore_t *sem) {
+    if (sem->permits == sem->max_permits) {
+        return false;
+    }
+    sem->permits++;
+    return true;
+}
+
+static inline void sem_acquire_blocking(semaphore_t *sem) {
+    if (!sem->permits) {
+        panic("semaphore would block for ever");
+    }
+    sem->permits--;
+}
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef W5X00_HOST_PICO_STDLIB_H
+#define W5X00_HOST_PICO_STDLIB_H
+
+#include "pico.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef W5X00_HOST_PICO_TIME_H
+#define W5X00_HOST_PICO_TIME_H
+
+#include "pico.h"
+
+// Time is virtual, see w5x00_host_advance_ps. It only moves on for SPI traffic and sleeps,
+// so runs are deterministic and independent of the speed of the host
+typedef uint64_t absolute_time_t;
+
+uint64_t time_us_64(void);
+
+static inline uint32_t time_us_32(void) {
+    return (uint32_t)time_us_64();
+}
+
+static inline absolute_time_t get_absolute_time(void) {
+    return time_us_64();
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t) {
+    return (uint32_t)(t / 1000);
+}
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us) {
+    return time_us_64() + us;
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return time_us_64() + ms * 1000ull;
+}
+
+static inline bool time_reached(absolute_time_t t) {
+    return time_us_64() >= t;
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+
+#define at_the_end_of_time ((absolute_time_t)UINT64_MAX)
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+static inline void busy_wait_us_32(uint32_t us) {
+    sleep_us(us);
+}
+
+#endif
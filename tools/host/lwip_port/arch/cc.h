@@ -0,0 +1,15 @@
+#ifndef W5X00_HOST_ARCH_CC_H
+#define W5X00_HOST_ARCH_CC_H
+
+// lwIP port for the host build, see tools/host. NO_SYS, so there's no sys_arch beyond sys_now in sys_arch.c
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LWIP_PLATFORM_DIAG(x)   do { printf x; } while (0)
+#define LWIP_PLATFORM_ASSERT(x) do { fprintf(stderr, "lwIP assertion \"%s\" failed at %s:%d\n", x, __FILE__, __LINE__); abort(); } while (0)
+
+// Runs must repeat exactly, so the same sequence every time
+#define LWIP_RAND()             ((u32_t)rand())
+
+#endif
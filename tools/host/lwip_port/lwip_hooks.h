@@ -0,0 +1,11 @@
+#ifndef W5X00_HOST_LWIP_HOOKS_H
+#define W5X00_HOST_LWIP_HOOKS_H
+
+#include "lwip/ip4_addr.h"
+
+struct netif;
+
+// The netif with the address src, NULL to route by dest as usual
+struct netif *w5x00_host_route_src(const ip4_addr_t *src, const ip4_addr_t *dest);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef W5X00_HOST_LWIPOPTS_H
+#define W5X00_HOST_LWIPOPTS_H
+
+// lwIP as a pico-sdk application would configure it with pico_lwip_nosys, for the host build of the
+// driver and w5x00_lwip.c, see tools/host. The driver's netif and the harness's peer netif share the one stack
+
+#define NO_SYS                      1
+#define LWIP_SOCKET                 0
+#define LWIP_NETCONN                0
+#define SYS_LIGHTWEIGHT_PROT        0
+
+#define MEM_LIBC_MALLOC             0
+#define MEM_ALIGNMENT               4
+#define MEM_SIZE                    (64 * 1024)
+#define MEMP_NUM_TCP_SEG            64
+#define MEMP_NUM_ARP_QUEUE          16
+// Shared by both netifs, and the size the soak starves to make the driver drop frames
+#ifndef PBUF_POOL_SIZE
+#define PBUF_POOL_SIZE              32
+#else
+// A pool smaller than TCP_WND fails lwIP's TCP sanity check, and only w5x00_lwip_bench uses TCP
+#define LWIP_DISABLE_TCP_SANITY_CHECKS 1
+#endif
+
+#define LWIP_ARP                    1
+#define LWIP_ETHERNET               1
+#define LWIP_IPV4                   1
+#define LWIP_IPV6                   0
+#define LWIP_ICMP                   1
+#define LWIP_RAW                    0
+#define LWIP_UDP                    1
+#define LWIP_TCP                    1
+#define LWIP_DHCP                   0
+#define LWIP_DNS                    0
+#define LWIP_IGMP                   1
+#define LWIP_NETIF_HOSTNAME         1
+#define LWIP_NETIF_STATUS_CALLBACK  0
+#define LWIP_NETIF_LINK_CALLBACK    0
+
+#define TCP_MSS                     1460
+#define TCP_WND                     (8 * TCP_MSS)
+#define TCP_SND_BUF                 (8 * TCP_MSS)
+#define TCP_SND_QUEUELEN            ((4 * (TCP_SND_BUF) + (TCP_MSS - 1)) / (TCP_MSS))
+// w5x00_lwip_bench writes without TCP_WRITE_FLAG_COPY, which takes a PBUF_ROM for each queued segment
+#define MEMP_NUM_PBUF               TCP_SND_QUEUELEN
+#define TCP_QUEUE_OOSEQ             0
+#define LWIP_TCP_KEEPALIVE          0
+
+#define LWIP_STATS                  0
+#define LWIP_STATS_DISPLAY          0
+#define MIB2_STATS                  0
+#define LWIP_CHKSUM_ALGORITHM       3
+
+// Both netifs are on the one subnet, so traffic leaves by the netif its source address belongs to, see sys_arch.c
+#define LWIP_HOOK_FILENAME          "lwip_hooks.h"
+#define LWIP_HOOK_IP4_ROUTE_SRC(src, dest) w5x00_host_route_src(src, dest)
+
+#endif
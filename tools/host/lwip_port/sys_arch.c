@@ -0,0 +1,21 @@
+#include "lwip/netif.h"
+#include "lwip/sys.h"
+#include "pico/time.h"
+
+// lwIP's timers run on the harness's virtual time, see w5x00_host.h
+u32_t sys_now(void) {
+    return to_ms_since_boot(get_absolute_time());
+}
+
+struct netif *w5x00_host_route_src(const ip4_addr_t *src, __unused const ip4_addr_t *dest) {
+    if (src == NULL) {
+        return NULL;
+    }
+    struct netif *netif;
+    NETIF_FOREACH(netif) {
+        if (netif_is_up(netif) && src->addr == netif_ip4_addr(netif)->addr) {
+            return netif;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,277 @@
+// Per frame cost of the driver's RX and TX paths across frame sizes, run on the host against
+// w5x00_model. For each size it reports the SPI transactions, bus bytes, DMA transfers, lock and
+// bus acquisitions and RAM copies each frame took, and the throughput the SPI bus would then allow.
+// These are counts, so unlike a timing on the target they're exact and repeatable
+//
+// Usage: w5x00_bench [-n frames] [-b frames_per_irq] [-s size,size,...] [-f spi_hz] [-c]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico/w5x00_driver.h"
+#include "w5x00_host.h"
+#include "w5x00_spi.h"
+#include "socket.h"
+
+#define BENCH_ETHERTYPE     (0x88b5)    // local experimental
+#define BENCH_HDR_LEN       (14 + 4)    // ethernet header and sequence number
+
+static const uint8_t bench_src_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+static struct {
+    w5x00_model_t model;
+    uint8_t frame[W5X00_MAX_FRAME_SIZE];
+    uint8_t rx_buf[W5X00_MAX_FRAME_SIZE];
+    uint32_t rx_seq;        // next sequence number expected
+    uint32_t tx_seq;
+    uint16_t size;
+    uint32_t errors;
+} bench;
+
+// Frames carry a sequence number and a pattern derived from it, so anything lost,
+// reordered or corrupted on the way through the driver shows up
+static void bench_build_frame(uint8_t *frame, const uint8_t *dst, uint32_t seq, uint16_t size) {
+    memcpy(frame, dst, 6);
+    memcpy(frame + 6, bench_src_mac, 6);
+    frame[12] = BENCH_ETHERTYPE >> 8;
+    frame[13] = BENCH_ETHERTYPE & 0xff;
+    memcpy(frame + 14, &seq, 4);
+    for (uint i = BENCH_HDR_LEN; i < size; i++) {
+        frame[i] = (uint8_t)(seq + i);
+    }
+}
+
+static bool bench_check_frame(const uint8_t *frame, uint16_t len, uint32_t seq) {
+    uint8_t want[W5X00_MAX_FRAME_SIZE];
+    if (len != bench.size) {
+        return false;
+    }
+    bench_build_frame(want, frame, seq, len);
+    return memcmp(frame, want, len) == 0;
+}
+
+// The lwIP free callbacks. The MACRAW socket is opened as w5x00_lwip.c does for its netif
+
+void w5x00_cb_tcpip_init(w5x00_t *self) {
+    WIZCHIP_EXPORT(socket)(0, Sn_MR_MACRAW, 0, 0);
+    self->tx_synced = false;
+    setSn_MR(0, getSn_MR(0) | Sn_MR_MFEN);
+}
+
+void w5x00_cb_tcpip_set_link_up(__unused w5x00_t *self) {
+}
+
+void w5x00_cb_tcpip_set_link_down(__unused w5x00_t *self) {
+    // Only the driver losing track of the chip takes the link down here
+    bench.errors++;
+}
+
+void w5x00_cb_process_ethernet(void *cb_data, size_t len) {
+    w5x00_t *self = cb_data;
+    w5x00_read_ethernet(self, 0, bench.rx_buf, (uint16_t)len);
+    if (!bench_check_frame(bench.rx_buf, (uint16_t)len, bench.rx_seq)) {
+        bench.errors++;
+    }
+    bench.rx_seq++;
+}
+
+static void bench_tx_cb(__unused w5x00_model_t *model, __unused uint8_t sn, const uint8_t *buf, uint16_t len, __unused void *arg) {
+    if (!bench_check_frame(buf, len, bench.tx_seq)) {
+        bench.errors++;
+    }
+    bench.tx_seq++;
+}
+
+// Let the driver run until done() or a second of virtual time passes
+static bool bench_settle(bool (*done)(uint32_t want), uint32_t want) {
+    uint64_t deadline = time_us_64() + 1000000;
+    w5x00_host_run();
+    while (!done(want)) {
+        if (time_us_64() >= deadline) {
+            return false;
+        }
+        w5x00_host_run_until(time_us_64() + 10);
+    }
+    return true;
+}
+
+static bool bench_rx_done(uint32_t want) {
+    return bench.rx_seq >= want;
+}
+
+static bool bench_tx_done(uint32_t want) {
+    return bench.tx_seq >= want;
+}
+
+typedef struct {
+    const char *dir;
+    uint16_t size;
+    uint32_t frames;
+    w5x00_stats_t stats;
+} bench_result_t;
+
+static bool bench_rx(w5x00_t *self, uint16_t size, uint32_t frames, uint32_t batch, bench_result_t *result) {
+    bench.size = size;
+    bench.rx_seq = 0;
+    w5x00_reset_stats(self);
+    for (uint32_t seq = 0; seq < frames;) {
+        // a batch arrives together, and is taken with as few interrupts as the driver manages
+        for (uint32_t i = 0; i < batch && seq < frames; i++, seq++) {
+            bench_build_frame(bench.frame, self->mac, seq, size);
+            if (w5x00_model_rx_frame(&bench.model, bench.frame, size) != W5X00_MODEL_RX_OK) {
+                fprintf(stderr, "rx %u: the chip dropped frame %u\n", size, seq);
+                return false;
+            }
+        }
+        if (!bench_settle(bench_rx_done, seq)) {
+            fprintf(stderr, "rx %u: %u of %u frames delivered\n", size, bench.rx_seq, seq);
+            return false;
+        }
+    }
+    result->dir = "rx";
+    result->size = size;
+    result->frames = frames;
+    w5x00_get_stats(self, &result->stats);
+    return true;
+}
+
+static bool bench_tx(w5x00_t *self, uint16_t size, uint32_t frames, bench_result_t *result) {
+    bench.size = size;
+    bench.tx_seq = 0;
+    w5x00_reset_stats(self);
+    for (uint32_t seq = 0; seq < frames; seq++) {
+        bench_build_frame(bench.frame, bench_src_mac, seq, size);
+        if (w5x00_send_ethernet(self, size, bench.frame, false) != 0) {
+            fprintf(stderr, "tx %u: send of frame %u failed\n", size, seq);
+            return false;
+        }
+        // take the SENDOK interrupts
+        w5x00_host_run();
+    }
+    if (!bench_settle(bench_tx_done, frames)) {
+        fprintf(stderr, "tx %u: %u of %u frames sent\n", size, bench.tx_seq, frames);
+        return false;
+    }
+    result->dir = "tx";
+    result->size = size;
+    result->frames = frames;
+    w5x00_get_stats(self, &result->stats);
+    return true;
+}
+
+static void bench_print(const bench_result_t *r, uint32_t spi_hz, bool csv) {
+    const w5x00_stats_t *s = &r->stats;
+    double n = r->frames;
+    uint64_t frame_bytes = (uint64_t)s->rx_bytes + s->tx_bytes;
+    double overhead = (s->spi_bytes - (double)frame_bytes) / n;
+    // bytes per second to Mbit/s
+    double mbps = w5x00_stats_spi_throughput_limit(s, spi_hz) * 8 / 1e6;
+    double mbps_20 = w5x00_stats_spi_throughput_limit(s, 20000000) * 8 / 1e6;
+    double mbps_40 = w5x00_stats_spi_throughput_limit(s, 40000000) * 8 / 1e6;
+    if (csv) {
+        printf("%s,%u,%u,%.2f,%.1f,%.1f,%.2f,%.2f,%.2f,%.2f,%.1f,%.2f,%.3f,%.3f,%.1f,%.1f,%.1f\n",
+            r->dir, r->size, r->frames, s->spi_transactions / n, s->spi_bytes / n, overhead,
+            s->dma_transfers / n, s->lock_acquires / n, s->bus_acquires / n, s->bus_nested / n,
+            s->copy_bytes / n, (double)s->bus_us / n, s->irqs / n, s->polls / n, mbps, mbps_20, mbps_40);
+    } else {
+        printf("%-3s %5u %8.2f %9.1f %8.1f %5.2f %6.2f %6.2f %7.2f %7.1f %8.2f %6.3f %6.3f %8.1f %8.1f %8.1f\n",
+            r->dir, r->size, s->spi_transactions / n, s->spi_bytes / n, overhead,
+            s->dma_transfers / n, s->lock_acquires / n, s->bus_acquires / n, s->bus_nested / n,
+            s->copy_bytes / n, (double)s->bus_us / n, s->irqs / n, s->polls / n, mbps, mbps_20, mbps_40);
+    }
+}
+
+static void bench_print_header(uint32_t spi_hz, bool csv) {
+    if (csv) {
+        printf("dir,size,frames,spi_transactions,spi_bytes,spi_overhead_bytes,dma_transfers,lock_acquires,"
+               "bus_acquires,bus_nested,copy_bytes,bus_us,irqs,polls,mbps_at_clock,mbps_at_20mhz,mbps_at_40mhz\n");
+    } else {
+        printf("W5x00 driver per frame costs, %s, SPI clock %u Hz\n", _WIZCHIP_ == W5500 ? "W5500" : "W5100S", spi_hz);
+        printf("%-3s %5s %8s %9s %8s %5s %6s %6s %7s %7s %8s %6s %6s %8s %8s %8s\n",
+            "dir", "size", "spi_txn", "spi_bytes", "overhead", "dma", "locks", "bus", "nested", "copied",
+            "bus_us", "irqs", "polls", "Mbps", "@20MHz", "@40MHz");
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n frames] [-b frames_per_irq] [-s size,size,...] [-f spi_hz] [-c]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = 1000;
+    uint32_t batch = 1;
+    uint32_t spi_hz = 0;
+    bool csv = false;
+    uint16_t sizes[32] = { 60, 128, 256, 512, 1024, 1514 };
+    uint size_count = 6;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:b:s:f:c")) != -1) {
+        switch (opt) {
+            case 'n': frames = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'b': batch = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'f': spi_hz = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'c': csv = true; break;
+            case 's':
+                size_count = 0;
+                for (char *tok = strtok(optarg, ","); tok && size_count < count_of(sizes); tok = strtok(NULL, ",")) {
+                    unsigned long size = strtoul(tok, NULL, 0);
+                    if (size < BENCH_HDR_LEN || size > W5X00_MAX_FRAME_SIZE) {
+                        fprintf(stderr, "frame sizes must be %u to %u\n", BENCH_HDR_LEN, W5X00_MAX_FRAME_SIZE);
+                        return 2;
+                    }
+                    sizes[size_count++] = (uint16_t)size;
+                }
+                break;
+            default: usage(argv[0]);
+        }
+    }
+    if (!frames || !batch || !size_count) {
+        usage(argv[0]);
+    }
+
+    w5x00_model_init(&bench.model);
+    w5x00_model_set_tx_callback(&bench.model, bench_tx_cb, NULL);
+    const w5x00_hw_config_t hw = W5X00_HW_CONFIG_DEFAULT;
+    w5x00_host_attach(&bench.model, &hw);
+
+    w5x00_t *self = &w5x00_state;
+    if (!w5x00_driver_init(w5x00_host_async_context())) {
+        fprintf(stderr, "w5x00_driver_init failed\n");
+        return 1;
+    }
+    w5x00_ethernet_set_up(self, true);
+    w5x00_host_run();
+    if (!self->itf_state) {
+        fprintf(stderr, "the chip didn't come up\n");
+        return 1;
+    }
+    if (spi_hz) {
+        w5x00_spi_set_baudrate(self, spi_hz);
+    }
+    spi_hz = w5x00_spi_get_baudrate(self);
+
+    bench_print_header(spi_hz, csv);
+    for (uint i = 0; i < size_count; i++) {
+        bench_result_t result;
+        if (!bench_rx(self, sizes[i], frames, batch, &result)) {
+            return 1;
+        }
+        bench_print(&result, spi_hz, csv);
+    }
+    for (uint i = 0; i < size_count; i++) {
+        bench_result_t result;
+        if (!bench_tx(self, sizes[i], frames, &result)) {
+            return 1;
+        }
+        bench_print(&result, spi_hz, csv);
+    }
+    if (bench.errors) {
+        fprintf(stderr, "%u frames were lost or corrupted\n", bench.errors);
+        return 1;
+    }
+    return 0;
+}
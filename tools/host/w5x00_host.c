@@ -0,0 +1,599 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/async_context.h"
+#include "pico/unique_id.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/spi.h"
+#include "w5x00_host.h"
+
+#define HOST_MAX_MODELS     (4)
+#define HOST_MAX_HANDLERS   (4)
+#define HOST_PS_PER_US      (1000000ull)
+
+static uint64_t host_time_ps;
+static w5x00_host_tick_cb_t host_tick_cb;
+static void *host_tick_arg;
+static bool host_in_tick;
+
+static struct {
+    w5x00_model_t *model;
+    w5x00_hw_config_t hw;
+} host_models[HOST_MAX_MODELS];
+static uint host_model_count;
+
+static struct {
+    bool out;
+    bool level;
+    bool pull_up;
+    uint32_t irq_events;
+    irq_handler_t handler;
+} host_gpio[NUM_BANK0_GPIOS];
+
+static bool host_irq_enabled[NUM_IRQS];
+static irq_handler_t host_irq_handlers[NUM_IRQS][HOST_MAX_HANDLERS];
+
+static struct {
+    bool claimed;
+    dma_channel_config config;
+    volatile void *write_addr;
+    const volatile void *read_addr;
+    uint count;
+} host_dma[NUM_DMA_CHANNELS];
+static uint32_t host_dma_irq_mask[2];
+static uint32_t host_dma_irq_status[2];
+
+static async_context_t host_context;
+
+uint w5x00_host_core_num;
+static bool (*host_core1_poll)(void);
+
+spi_inst_t w5x00_host_spi_inst[2] = {
+    { .index = 0 },
+    { .index = 1 },
+};
+
+// Time
+
+uint64_t w5x00_host_time_ps(void) {
+    return host_time_ps;
+}
+
+uint64_t time_us_64(void) {
+    return host_time_ps / HOST_PS_PER_US;
+}
+
+void w5x00_host_advance_ps(uint64_t ps) {
+    host_time_ps += ps;
+    if (host_tick_cb && !host_in_tick) {
+        host_in_tick = true;
+        host_tick_cb(time_us_64(), host_tick_arg);
+        host_in_tick = false;
+    }
+}
+
+static void host_advance_to_us(uint64_t us) {
+    if (us * HOST_PS_PER_US > host_time_ps) {
+        w5x00_host_advance_ps(us * HOST_PS_PER_US - host_time_ps);
+    }
+}
+
+void w5x00_host_set_tick_callback(w5x00_host_tick_cb_t cb, void *arg) {
+    host_tick_cb = cb;
+    host_tick_arg = arg;
+}
+
+void sleep_us(uint64_t us) {
+    w5x00_host_advance_ps(us * HOST_PS_PER_US);
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_us(ms * 1000ull);
+}
+
+// Misc
+
+void panic(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    fputs("panic: ", stderr);
+    vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+    abort();
+}
+
+void pico_get_unique_board_id(pico_unique_board_id_t *id_out) {
+    static const uint8_t id[PICO_UNIQUE_BOARD_ID_SIZE_BYTES] = { 0xe6, 0x61, 0x38, 0x52, 0x83, 0x2a, 0x5c, 0x21 };
+    memcpy(id_out->id, id, sizeof(id));
+}
+
+void w5x00_host_attach(w5x00_model_t *model, const w5x00_hw_config_t *hw) {
+    assert(host_model_count < HOST_MAX_MODELS);
+    host_models[host_model_count].model = model;
+    host_models[host_model_count].hw = *hw;
+    host_model_count++;
+}
+
+// GPIO
+
+static void host_gpio_changed(uint gpio, bool level) {
+    for (uint i = 0; i < host_model_count; i++) {
+        if (host_models[i].hw.csn_pin == gpio) {
+            w5x00_model_select(host_models[i].model, !level);
+        }
+        if (host_models[i].hw.rstn_pin == gpio) {
+            w5x00_model_set_reset(host_models[i].model, !level);
+        }
+    }
+}
+
+void gpio_init(uint gpio) {
+    host_gpio[gpio].out = false;
+    host_gpio[gpio].level = false;
+    host_gpio[gpio].irq_events = 0;
+}
+
+void gpio_set_function(__unused uint gpio, __unused uint fn) {
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+    host_gpio[gpio].out = out;
+}
+
+void gpio_set_pulls(uint gpio, bool up, __unused bool down) {
+    host_gpio[gpio].pull_up = up;
+}
+
+bool gpio_get(uint gpio) {
+    for (uint i = 0; i < host_model_count; i++) {
+        if (host_models[i].hw.intn_pin == gpio) {
+            return w5x00_model_intn(host_models[i].model);
+        }
+    }
+    return host_gpio[gpio].out ? host_gpio[gpio].level : host_gpio[gpio].pull_up;
+}
+
+static void host_gpio_put_mask(uint32_t mask, bool level) {
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++) {
+        if ((mask & (1u << gpio)) && host_gpio[gpio].level != level) {
+            host_gpio[gpio].level = level;
+            host_gpio_changed(gpio, level);
+        }
+    }
+}
+
+void gpio_set_mask(uint32_t mask) {
+    host_gpio_put_mask(mask, true);
+}
+
+void gpio_clr_mask(uint32_t mask) {
+    host_gpio_put_mask(mask, false);
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled) {
+    if (enabled) {
+        host_gpio[gpio].irq_events |= event_mask;
+    } else {
+        host_gpio[gpio].irq_events &= ~event_mask;
+    }
+}
+
+uint32_t gpio_get_irq_event_mask(uint gpio) {
+    uint32_t events = 0;
+    bool level = gpio_get(gpio);
+    if ((host_gpio[gpio].irq_events & GPIO_IRQ_LEVEL_LOW) && !level) {
+        events |= GPIO_IRQ_LEVEL_LOW;
+    }
+    if ((host_gpio[gpio].irq_events & GPIO_IRQ_LEVEL_HIGH) && level) {
+        events |= GPIO_IRQ_LEVEL_HIGH;
+    }
+    return events;
+}
+
+void gpio_acknowledge_irq(__unused uint gpio, __unused uint32_t event_mask) {
+}
+
+void gpio_add_raw_irq_handler_with_order_priority(uint gpio, irq_handler_t handler, __unused uint8_t order_priority) {
+    host_gpio[gpio].handler = handler;
+}
+
+void gpio_remove_raw_irq_handler(uint gpio, irq_handler_t handler) {
+    if (host_gpio[gpio].handler == handler) {
+        host_gpio[gpio].handler = NULL;
+    }
+}
+
+// IRQ
+
+void irq_set_enabled(uint num, bool enabled) {
+    host_irq_enabled[num] = enabled;
+}
+
+bool irq_is_enabled(uint num) {
+    return host_irq_enabled[num];
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, __unused uint8_t order_priority) {
+    for (uint i = 0; i < HOST_MAX_HANDLERS; i++) {
+        if (!host_irq_handlers[num][i]) {
+            host_irq_handlers[num][i] = handler;
+            return;
+        }
+    }
+    panic("too many handlers for irq %u", num);
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+    for (uint i = 0; i < HOST_MAX_HANDLERS; i++) {
+        if (host_irq_handlers[num][i] == handler) {
+            host_irq_handlers[num][i] = NULL;
+        }
+    }
+}
+
+static void host_irq_raise(uint num) {
+    if (!host_irq_enabled[num]) {
+        return;
+    }
+    for (uint i = 0; i < HOST_MAX_HANDLERS; i++) {
+        if (host_irq_handlers[num][i]) {
+            host_irq_handlers[num][i]();
+        }
+    }
+}
+
+static bool host_take_gpio_irqs(void) {
+    bool taken = false;
+    if (!host_irq_enabled[IO_IRQ_BANK0]) {
+        return false;
+    }
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++) {
+        if (host_gpio[gpio].handler && gpio_get_irq_event_mask(gpio)) {
+            host_gpio[gpio].handler();
+            taken = true;
+        }
+    }
+    return taken;
+}
+
+// SPI
+
+// As the pico-sdk works out the dividers, so the clocks are the ones the hardware can make
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate) {
+    const uint64_t freq_in = W5X00_HOST_SPI_CLK_HZ;
+    uint prescale, postdiv;
+    for (prescale = 2; prescale <= 254; prescale += 2) {
+        if (freq_in < (prescale + 2) * 256 * (uint64_t)baudrate) {
+            break;
+        }
+    }
+    for (postdiv = 256; postdiv > 1; --postdiv) {
+        if (freq_in / (prescale * (postdiv - 1)) > baudrate) {
+            break;
+        }
+    }
+    spi->baudrate = (uint)(freq_in / (prescale * postdiv));
+    return spi->baudrate;
+}
+
+uint spi_get_baudrate(const spi_inst_t *spi) {
+    return spi->baudrate;
+}
+
+uint spi_init(spi_inst_t *spi, uint baudrate) {
+    return spi_set_baudrate(spi, baudrate);
+}
+
+void spi_deinit(__unused spi_inst_t *spi) {
+}
+
+static uint8_t host_spi_transfer(spi_inst_t *spi, uint8_t mosi) {
+    assert(spi->baudrate);
+    w5x00_host_advance_ps(8 * 1000000000000ull / spi->baudrate);
+    uint8_t miso = 0xff;
+    for (uint i = 0; i < host_model_count; i++) {
+        if (host_models[i].hw.spi == spi && !host_gpio[host_models[i].hw.csn_pin].level) {
+            miso = w5x00_model_transfer(host_models[i].model, mosi);
+        }
+    }
+    return miso;
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        host_spi_transfer(spi, src[i]);
+    }
+    return (int)len;
+}
+
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = host_spi_transfer(spi, repeated_tx_data);
+    }
+    return (int)len;
+}
+
+// DMA
+
+int dma_claim_unused_channel(bool required) {
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        if (!host_dma[ch].claimed) {
+            host_dma[ch].claimed = true;
+            return (int)ch;
+        }
+    }
+    if (required) {
+        panic("no DMA channels are free");
+    }
+    return -1;
+}
+
+void dma_channel_unclaim(uint channel) {
+    host_dma[channel].claimed = false;
+}
+
+void dma_channel_cleanup(uint channel) {
+    host_dma_irq_mask[0] &= ~(1u << channel);
+    host_dma_irq_mask[1] &= ~(1u << channel);
+    host_dma_irq_status[0] &= ~(1u << channel);
+    host_dma_irq_status[1] &= ~(1u << channel);
+}
+
+dma_channel_config dma_channel_get_default_config(__unused uint channel) {
+    dma_channel_config c = {
+        .read_increment = true,
+        .write_increment = false,
+        .dreq = DREQ_FORCE,
+        .size = DMA_SIZE_32,
+    };
+    return c;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    host_dma[channel].config = *config;
+    host_dma[channel].write_addr = write_addr;
+    host_dma[channel].read_addr = read_addr;
+    host_dma[channel].count = transfer_count;
+    if (trigger) {
+        dma_start_channel_mask(1u << channel);
+    }
+}
+
+static spi_inst_t *host_dma_spi(const volatile void *addr) {
+    for (uint i = 0; i < count_of(w5x00_host_spi_inst); i++) {
+        if (addr == (const volatile void *)&w5x00_host_spi_inst[i].hw.dr) {
+            return &w5x00_host_spi_inst[i];
+        }
+    }
+    return NULL;
+}
+
+// Runs the transfers to completion, a pair of channels feeding and draining the same SPI
+// being one full duplex transfer
+void dma_start_channel_mask(uint32_t chan_mask) {
+    int tx = -1, rx = -1;
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        if (!(chan_mask & (1u << ch))) {
+            continue;
+        }
+        assert(host_dma[ch].config.size == DMA_SIZE_8);
+        if (host_dma_spi(host_dma[ch].write_addr)) {
+            tx = (int)ch;
+        } else if (host_dma_spi(host_dma[ch].read_addr)) {
+            rx = (int)ch;
+        } else {
+            panic("host DMA only supports transfers to and from SPI");
+        }
+    }
+    spi_inst_t *spi = tx >= 0 ? host_dma_spi(host_dma[tx].write_addr) : host_dma_spi(host_dma[rx].read_addr);
+    assert(tx < 0 || rx < 0 || spi == host_dma_spi(host_dma[rx].read_addr));
+    uint count = tx >= 0 ? host_dma[tx].count : host_dma[rx].count;
+    for (uint i = 0; i < count; i++) {
+        uint8_t mosi = 0xff;
+        if (tx >= 0) {
+            const volatile uint8_t *src = host_dma[tx].read_addr;
+            mosi = src[host_dma[tx].config.read_increment ? i : 0];
+        }
+        uint8_t miso = host_spi_transfer(spi, mosi);
+        if (rx >= 0) {
+            volatile uint8_t *dst = host_dma[rx].write_addr;
+            dst[host_dma[rx].config.write_increment ? i : 0] = miso;
+        }
+    }
+    for (uint n = 0; n < 2; n++) {
+        host_dma_irq_status[n] |= chan_mask & host_dma_irq_mask[n];
+        if (host_dma_irq_status[n]) {
+            host_irq_raise(DMA_IRQ_0 + n);
+        }
+    }
+}
+
+void dma_irqn_set_channel_enabled(uint irq_index, uint channel, bool enabled) {
+    if (enabled) {
+        host_dma_irq_mask[irq_index] |= 1u << channel;
+    } else {
+        host_dma_irq_mask[irq_index] &= ~(1u << channel);
+    }
+}
+
+bool dma_irqn_get_channel_status(uint irq_index, uint channel) {
+    return host_dma_irq_status[irq_index] & (1u << channel);
+}
+
+void dma_irqn_acknowledge_channel(uint irq_index, uint channel) {
+    host_dma_irq_status[irq_index] &= ~(1u << channel);
+}
+
+// async_context
+
+async_context_t *w5x00_host_async_context(void) {
+    return &host_context;
+}
+
+void async_context_acquire_lock_blocking(async_context_t *context) {
+    context->lock_depth++;
+}
+
+void async_context_release_lock(async_context_t *context) {
+    assert(context->lock_depth);
+    context->lock_depth--;
+}
+
+void async_context_lock_check(async_context_t *context) {
+    if (!context->lock_depth) {
+        panic("async_context lock not held");
+    }
+}
+
+bool async_context_add_at_time_worker(async_context_t *context, async_at_time_worker_t *worker) {
+    for (async_at_time_worker_t *w = context->at_time_list; w; w = w->next) {
+        if (w == worker) {
+            return true;
+        }
+    }
+    worker->next = context->at_time_list;
+    context->at_time_list = worker;
+    return true;
+}
+
+bool async_context_add_at_time_worker_at(async_context_t *context, async_at_time_worker_t *worker, absolute_time_t at) {
+    worker->next_time = at;
+    return async_context_add_at_time_worker(context, worker);
+}
+
+bool async_context_add_at_time_worker_in_ms(async_context_t *context, async_at_time_worker_t *worker, uint32_t ms) {
+    return async_context_add_at_time_worker_at(context, worker, make_timeout_time_ms(ms));
+}
+
+bool async_context_remove_at_time_worker(async_context_t *context, async_at_time_worker_t *worker) {
+    for (async_at_time_worker_t **p = &context->at_time_list; *p; p = &(*p)->next) {
+        if (*p == worker) {
+            *p = worker->next;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool async_context_add_when_pending_worker(async_context_t *context, async_when_pending_worker_t *worker) {
+    for (async_when_pending_worker_t *w = context->when_pending_list; w; w = w->next) {
+        if (w == worker) {
+            return true;
+        }
+    }
+    worker->next = context->when_pending_list;
+    context->when_pending_list = worker;
+    return true;
+}
+
+bool async_context_remove_when_pending_worker(async_context_t *context, async_when_pending_worker_t *worker) {
+    for (async_when_pending_worker_t **p = &context->when_pending_list; *p; p = &(*p)->next) {
+        if (*p == worker) {
+            *p = worker->next;
+            return true;
+        }
+    }
+    return false;
+}
+
+void async_context_set_work_pending(__unused async_context_t *context, async_when_pending_worker_t *worker) {
+    worker->work_pending = true;
+}
+
+uint32_t async_context_execute_sync(async_context_t *context, uint32_t (*func)(void *param), void *param) {
+    async_context_acquire_lock_blocking(context);
+    uint32_t ret = func(param);
+    async_context_release_lock(context);
+    return ret;
+}
+
+void async_context_wait_until(__unused async_context_t *context, absolute_time_t until) {
+    host_advance_to_us(until);
+}
+
+void async_context_wait_for_work_until(__unused async_context_t *context, absolute_time_t until) {
+    host_advance_to_us(until);
+}
+
+void w5x00_host_start_core1(void (*init)(void), bool (*poll)(void)) {
+    w5x00_host_core_num = 1;
+    init();
+    w5x00_host_core_num = 0;
+    host_core1_poll = poll;
+}
+
+// Core 1 gets a pass between core 0's workers, as it would run alongside them. Returns true if it
+// has more to do
+static bool host_run_core1(void) {
+    if (!host_core1_poll) {
+        return false;
+    }
+    w5x00_host_core_num = 1;
+    bool busy = host_core1_poll();
+    w5x00_host_core_num = 0;
+    return busy;
+}
+
+static bool host_core1_busy;
+
+// Returns true if core 0 did anything
+static bool host_run_once(void) {
+    async_context_t *context = &host_context;
+    assert(!context->lock_depth);
+    bool did = host_take_gpio_irqs();
+    uint64_t now = time_us_64();
+    for (async_at_time_worker_t *w = context->at_time_list; w; w = w->next) {
+        if (w->next_time <= now) {
+            // removed before it runs, so it can add itself again
+            async_context_remove_at_time_worker(context, w);
+            context->lock_depth++;
+            w->do_work(context, w);
+            context->lock_depth--;
+            return true;
+        }
+    }
+    for (async_when_pending_worker_t *w = context->when_pending_list; w; w = w->next) {
+        if (w->work_pending) {
+            w->work_pending = false;
+            context->lock_depth++;
+            w->do_work(context, w);
+            context->lock_depth--;
+            did = true;
+        }
+    }
+    return did;
+}
+
+void w5x00_host_run(void) {
+    // Core 0's work costs no time, so it's all done before core 1 takes its next pass. That leaves the
+    // caller to run as core 0's application would, between passes
+    while (host_run_once());
+    host_core1_busy = host_run_core1();
+    while (host_run_once());
+}
+
+void w5x00_host_run_until(uint64_t until_us) {
+    for (;;) {
+        w5x00_host_run();
+        uint64_t now = time_us_64();
+        if (now >= until_us) {
+            break;
+        }
+        if (host_core1_busy) {
+            // Core 1's time moves on as it uses the bus
+            continue;
+        }
+        uint64_t next = until_us;
+        for (async_at_time_worker_t *w = host_context.at_time_list; w; w = w->next) {
+            if (w->next_time < next) {
+                next = w->next_time;
+            }
+        }
+        host_advance_to_us(MAX(next, now + 1));
+    }
+}
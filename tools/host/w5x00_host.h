@@ -0,0 +1,40 @@
+#ifndef W5X00_INCLUDED_W5X00_HOST_H
+#define W5X00_INCLUDED_W5X00_HOST_H
+
+// Runs pico_w5x00_driver on a Linux host against w5x00_model. The pico-sdk calls the driver
+// makes are provided by include/ and w5x00_host.c: GPIO and SPI are wired to the model, DMA
+// moves bytes through it, and a single threaded async_context runs the driver's workers.
+//
+// Time is virtual. It moves on by the SPI clock for every byte on the bus and by the length
+// of every sleep, and nothing else, so results depend only on the driver and the model
+
+#include "pico/async_context.h"
+#include "w5x00.h"
+#include "w5x00_model.h"
+
+// Picoseconds, so that a byte at any SPI clock advances time by a whole number
+uint64_t w5x00_host_time_ps(void);
+void w5x00_host_advance_ps(uint64_t ps);
+
+// Called whenever time has moved on, e.g. to hand the model the frames due by then. It
+// mustn't call the driver, which may be part way through an SPI transaction
+typedef void (*w5x00_host_tick_cb_t)(uint64_t now_us, void *arg);
+void w5x00_host_set_tick_callback(w5x00_host_tick_cb_t cb, void *arg);
+
+// Wire a model to the SPI port and pins of a chip
+void w5x00_host_attach(w5x00_model_t *model, const w5x00_hw_config_t *hw);
+
+async_context_t *w5x00_host_async_context(void);
+
+// Run a second core, as for W5X00_PIPE. init is called as core 1 now, and poll as core 1 once in every
+// w5x00_host_run. poll returns false when it would sleep, and until it does w5x00_host_run_until lets
+// time pass only as core 1 uses the bus
+void w5x00_host_start_core1(void (*init)(void), bool (*poll)(void));
+
+// Take pending interrupts and run the due async_context work, until there's none left. With a second
+// core it gets one pass, and core 0's work is run again after it
+void w5x00_host_run(void);
+// As w5x00_host_run, letting time pass up to until_us so timers fire
+void w5x00_host_run_until(uint64_t until_us);
+
+#endif
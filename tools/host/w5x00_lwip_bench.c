@@ -0,0 +1,578 @@
+// End to end benchmark of the driver with lwIP, run on the host against w5x00_model. The driver's netif
+// runs the real w5x00_lwip.c glue, and talks over a 100 Mbit/s wire to a peer netif in the same (NO_SYS)
+// lwIP stack. For each SPI clock it runs
+//
+//   ping  UDP echo of each size from the peer, round trip time percentiles
+//   tcp   bulk transfer from the peer to the driver (rx) and back (tx), throughput
+//   udp   flood of datagrams from the peer at the wire rate, what arrives and what the chip dropped
+//
+// Time is virtual (see w5x00_host.h) and only moves for SPI traffic, sleeps and the wire. lwIP and
+// the driver's own code take no time, so these are the limits the SPI bus sets
+//
+// Usage: w5x00_lwip_bench [-f spi_hz,spi_hz,...] [-n pings] [-s size,size,...] [-t tcp_bytes] [-u udp_frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico/w5x00_driver.h"
+#include "w5x00_host.h"
+#include "w5x00_spi.h"
+
+#include "lwip/init.h"
+#include "lwip/etharp.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+#include "lwip/timeouts.h"
+#include "lwip/udp.h"
+#include "netif/ethernet.h"
+
+#define NET_WIRE_QUEUE_LEN  (64)
+// Preamble, FCS and inter frame gap around each frame on the wire
+#define NET_WIRE_OVERHEAD   (8 + 4 + 12)
+// 100 Mbit/s
+#define NET_WIRE_PS_PER_BIT (10000ull)
+
+#define NET_ECHO_PORT       (7)
+#define NET_TCP_PORT        (5001)
+#define NET_FLOOD_PORT      (9)
+#define NET_MAX_PINGS       (10000)
+
+static const uint8_t net_peer_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+// One direction of the wire. Frames are delivered once their last bit has arrived
+typedef struct {
+    struct {
+        uint64_t due_ps;
+        uint16_t len;
+        uint8_t data[W5X00_MAX_FRAME_SIZE];
+    } frames[NET_WIRE_QUEUE_LEN];
+    uint head;
+    uint count;
+    uint64_t idle_ps;   // when the last frame queued has been sent
+    uint32_t dropped;   // arrived to a full queue, as a switch would drop them
+} net_wire_t;
+
+static struct {
+    w5x00_model_t model;
+    struct netif peer;
+    net_wire_t to_chip;
+    net_wire_t to_peer;
+    uint32_t peer_pbuf_fail;
+
+    // ping
+    struct udp_pcb *echo_pcb;
+    struct udp_pcb *ping_pcb;
+    uint64_t ping_sent_ps;
+    uint32_t ping_rtt_ns[NET_MAX_PINGS];
+    uint32_t pongs;
+    uint16_t ping_size;
+
+    // tcp
+    struct tcp_pcb *tcp_listen;
+    struct tcp_pcb *tcp_tx;     // sending end
+    struct tcp_pcb *tcp_rx;     // receiving end
+    uint32_t tcp_to_write;
+    uint32_t tcp_received;
+    bool tcp_failed;
+
+    // udp flood
+    struct udp_pcb *sink_pcb;
+    struct udp_pcb *flood_pcb;
+    uint32_t flood_received;
+    uint32_t flood_bytes;
+} net;
+
+static uint8_t net_payload[TCP_SND_BUF];
+
+// Wire
+
+static void net_wire_send(net_wire_t *wire, const uint8_t *buf, uint16_t len) {
+    if (wire->count == NET_WIRE_QUEUE_LEN || len > W5X00_MAX_FRAME_SIZE) {
+        wire->dropped++;
+        return;
+    }
+    uint64_t start_ps = MAX(w5x00_host_time_ps(), wire->idle_ps);
+    wire->idle_ps = start_ps + (MAX(len, 60) + NET_WIRE_OVERHEAD) * 8 * NET_WIRE_PS_PER_BIT;
+    uint i = (wire->head + wire->count++) % NET_WIRE_QUEUE_LEN;
+    wire->frames[i].due_ps = wire->idle_ps;
+    wire->frames[i].len = len;
+    memcpy(wire->frames[i].data, buf, len);
+}
+
+static bool net_wire_due(const net_wire_t *wire) {
+    return wire->count && wire->frames[wire->head].due_ps <= w5x00_host_time_ps();
+}
+
+static uint64_t net_wire_next_us(const net_wire_t *wire) {
+    if (!wire->count) {
+        return UINT64_MAX;
+    }
+    return (wire->frames[wire->head].due_ps + 999999) / 1000000;
+}
+
+// Frames reach the chip as time passes, even part way through an SPI transfer
+static void net_tick(__unused uint64_t now_us, __unused void *arg) {
+    while (net_wire_due(&net.to_chip)) {
+        w5x00_model_rx_frame(&net.model, net.to_chip.frames[net.to_chip.head].data, net.to_chip.frames[net.to_chip.head].len);
+        net.to_chip.head = (net.to_chip.head + 1) % NET_WIRE_QUEUE_LEN;
+        net.to_chip.count--;
+    }
+}
+
+// The chip sends from inside the driver, which lwIP may have called, so the peer is given the
+// frame later from net_poll
+static void net_chip_tx(__unused w5x00_model_t *model, uint8_t sn, const uint8_t *buf, uint16_t len, __unused void *arg) {
+    if (sn != 0) {
+        return;
+    }
+    net_wire_send(&net.to_peer, buf, len);
+}
+
+static void net_peer_deliver(void) {
+    while (net_wire_due(&net.to_peer)) {
+        uint16_t len = net.to_peer.frames[net.to_peer.head].len;
+        struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+        if (p) {
+            pbuf_take(p, net.to_peer.frames[net.to_peer.head].data, len);
+        } else {
+            net.peer_pbuf_fail++;
+        }
+        net.to_peer.head = (net.to_peer.head + 1) % NET_WIRE_QUEUE_LEN;
+        net.to_peer.count--;
+        if (p && net.peer.input(p, &net.peer) != ERR_OK) {
+            pbuf_free(p);
+        }
+    }
+}
+
+static err_t net_peer_linkoutput(__unused struct netif *netif, struct pbuf *p) {
+    static uint8_t frame[W5X00_MAX_FRAME_SIZE];
+    if (p->tot_len > sizeof(frame)) {
+        return ERR_IF;
+    }
+    net_wire_send(&net.to_chip, frame, pbuf_copy_partial(p, frame, p->tot_len, 0));
+    return ERR_OK;
+}
+
+static err_t net_peer_init(struct netif *netif) {
+    netif->name[0] = 'p';
+    netif->name[1] = '0';
+    netif->linkoutput = net_peer_linkoutput;
+    netif->output = etharp_output;
+    netif->mtu = 1500;
+    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET;
+    memcpy(netif->hwaddr, net_peer_mac, 6);
+    netif->hwaddr_len = 6;
+    return ERR_OK;
+}
+
+// Running
+
+static void net_poll(void) {
+    w5x00_host_run();
+    net_peer_deliver();
+    sys_check_timeouts();
+}
+
+// Let everything run until done() or timeout_us of virtual time passes
+static bool net_run(bool (*done)(void), uint64_t timeout_us) {
+    uint64_t deadline = time_us_64() + timeout_us;
+    for (;;) {
+        net_poll();
+        if (done()) {
+            return true;
+        }
+        uint64_t now = time_us_64();
+        if (now >= deadline) {
+            return false;
+        }
+        // Until the next frame arrives at either end, checking lwIP's timers every ms
+        uint64_t next = MIN(deadline, now + 1000);
+        next = MIN(next, net_wire_next_us(&net.to_chip));
+        next = MIN(next, net_wire_next_us(&net.to_peer));
+        w5x00_host_run_until(MAX(next, now + 1));
+    }
+}
+
+static bool net_quiet(void) {
+    return !net.to_chip.count && !net.to_peer.count && !w5x00_model_rx_used(&net.model);
+}
+
+static int net_cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// sorted must be sorted
+static uint32_t net_percentile(const uint32_t *sorted, uint32_t count, uint percent) {
+    if (!count) {
+        return 0;
+    }
+    uint32_t i = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+    return sorted[MIN(MAX(i, 1), count) - 1];
+}
+
+// Ping
+
+static void net_ping_send(void) {
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, net.ping_size, PBUF_RAM);
+    if (!p) {
+        return;
+    }
+    pbuf_take(p, net_payload, net.ping_size);
+    ip_addr_t dst;
+    ip_addr_copy(dst, *netif_ip_addr4(&w5x00_state.netif));
+    net.ping_sent_ps = w5x00_host_time_ps();
+    udp_sendto(net.ping_pcb, p, &dst, NET_ECHO_PORT);
+    pbuf_free(p);
+}
+
+static void net_echo_recv(__unused void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
+    udp_sendto(pcb, p, addr, port);
+    pbuf_free(p);
+}
+
+static void net_pong_recv(__unused void *arg, __unused struct udp_pcb *pcb, struct pbuf *p, __unused const ip_addr_t *addr, __unused u16_t port) {
+    if (net.pongs < NET_MAX_PINGS) {
+        net.ping_rtt_ns[net.pongs] = (uint32_t)((w5x00_host_time_ps() - net.ping_sent_ps) / 1000);
+    }
+    net.pongs++;
+    pbuf_free(p);
+}
+
+static uint32_t net_pings_wanted;
+
+static bool net_pong_done(void) {
+    return net.pongs >= net_pings_wanted;
+}
+
+static bool net_ping(w5x00_t *self, uint16_t size, uint32_t pings) {
+    net.ping_size = size;
+    // The first exchanges fill the ARP caches
+    for (uint i = 0; i < 4; i++) {
+        net.pongs = 0;
+        net_pings_wanted = 1;
+        net_ping_send();
+        net_run(net_pong_done, 100000);
+    }
+    w5x00_reset_stats(self);
+    for (net.pongs = 0; net.pongs < pings;) {
+        net_pings_wanted = net.pongs + 1;
+        net_ping_send();
+        if (!net_run(net_pong_done, 100000)) {
+            fprintf(stderr, "ping %u: no reply to ping %u\n", size, net.pongs);
+            return false;
+        }
+    }
+    w5x00_stats_t stats;
+    w5x00_get_stats(self, &stats);
+    uint32_t n = MIN(pings, NET_MAX_PINGS);
+    qsort(net.ping_rtt_ns, n, sizeof(net.ping_rtt_ns[0]), net_cmp_u32);
+    printf("ping %4u %10.1f %10.1f %10.1f %10.1f %8u %8u %9.1f\n", size,
+        net_percentile(net.ping_rtt_ns, n, 50) / 1e3, net_percentile(net.ping_rtt_ns, n, 90) / 1e3,
+        net_percentile(net.ping_rtt_ns, n, 99) / 1e3, net.ping_rtt_ns[n - 1] / 1e3,
+        w5x00_stats_rx_latency_percentile(&stats, 50), w5x00_stats_rx_latency_percentile(&stats, 99),
+        (double)stats.spi_bytes / pings);
+    return true;
+}
+
+// TCP bulk
+
+static void net_tcp_push(struct tcp_pcb *pcb) {
+    while (net.tcp_to_write) {
+        uint32_t n = MIN(MIN(net.tcp_to_write, tcp_sndbuf(pcb)), sizeof(net_payload));
+        if (!n || tcp_write(pcb, net_payload, (u16_t)n, 0) != ERR_OK) {
+            break;
+        }
+        net.tcp_to_write -= n;
+    }
+    tcp_output(pcb);
+}
+
+static err_t net_tcp_sent(__unused void *arg, struct tcp_pcb *pcb, __unused u16_t len) {
+    net_tcp_push(pcb);
+    return ERR_OK;
+}
+
+static err_t net_tcp_recv(__unused void *arg, struct tcp_pcb *pcb, struct pbuf *p, __unused err_t err) {
+    if (!p) {
+        return ERR_OK;
+    }
+    net.tcp_received += p->tot_len;
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static void net_tcp_err(void *arg, __unused err_t err) {
+    // The pcb has already been freed
+    if (arg == &net.tcp_tx) {
+        net.tcp_tx = NULL;
+    } else {
+        net.tcp_rx = NULL;
+    }
+    net.tcp_failed = true;
+}
+
+static void net_tcp_start(struct tcp_pcb *pcb, bool sending) {
+    struct tcp_pcb **end = sending ? &net.tcp_tx : &net.tcp_rx;
+    *end = pcb;
+    tcp_arg(pcb, end);
+    tcp_err(pcb, net_tcp_err);
+    tcp_recv(pcb, net_tcp_recv);
+    tcp_nagle_disable(pcb);
+    if (sending) {
+        tcp_sent(pcb, net_tcp_sent);
+        net_tcp_push(pcb);
+    }
+}
+
+static bool net_tcp_driver_sends;
+
+static err_t net_tcp_accepted(__unused void *arg, struct tcp_pcb *pcb, err_t err) {
+    if (err != ERR_OK || !pcb) {
+        return ERR_VAL;
+    }
+    net_tcp_start(pcb, net_tcp_driver_sends);
+    return ERR_OK;
+}
+
+static err_t net_tcp_connected(__unused void *arg, struct tcp_pcb *pcb, __unused err_t err) {
+    net_tcp_start(pcb, !net_tcp_driver_sends);
+    return ERR_OK;
+}
+
+static uint32_t net_tcp_wanted;
+
+static bool net_tcp_done(void) {
+    return net.tcp_failed || net.tcp_received >= net_tcp_wanted;
+}
+
+static bool net_tcp_connected_both(void) {
+    return net.tcp_failed || (net.tcp_tx && net.tcp_rx);
+}
+
+static void net_tcp_close(void) {
+    if (net.tcp_tx) {
+        tcp_arg(net.tcp_tx, NULL);
+        tcp_err(net.tcp_tx, NULL);
+        tcp_abort(net.tcp_tx);
+        net.tcp_tx = NULL;
+    }
+    if (net.tcp_rx) {
+        tcp_arg(net.tcp_rx, NULL);
+        tcp_err(net.tcp_rx, NULL);
+        tcp_abort(net.tcp_rx);
+        net.tcp_rx = NULL;
+    }
+    net_run(net_quiet, 100000);
+}
+
+// The driver's end listens, the peer connects. driver_sends picks the direction of the data
+static bool net_tcp(w5x00_t *self, bool driver_sends, uint32_t bytes) {
+    const char *dir = driver_sends ? "tx" : "rx";
+    net_tcp_driver_sends = driver_sends;
+    net.tcp_failed = false;
+    net.tcp_received = 0;
+    net.tcp_to_write = 0;
+
+    struct tcp_pcb *pcb = tcp_new();
+    ip_addr_t peer_ip;
+    ip_addr_copy(peer_ip, *netif_ip_addr4(&net.peer));
+    tcp_bind(pcb, &peer_ip, 0);
+    ip_addr_t driver_ip;
+    ip_addr_copy(driver_ip, *netif_ip_addr4(&self->netif));
+    tcp_connect(pcb, &driver_ip, NET_TCP_PORT, net_tcp_connected);
+    if (!net_run(net_tcp_connected_both, 1000000) || net.tcp_failed) {
+        fprintf(stderr, "tcp %s: couldn't connect\n", dir);
+        net_tcp_close();
+        return false;
+    }
+
+    w5x00_reset_stats(self);
+    uint64_t start_ps = w5x00_host_time_ps();
+    net_tcp_wanted = bytes;
+    net.tcp_to_write = bytes;
+    net_tcp_push(net.tcp_tx);
+    bool ok = net_run(net_tcp_done, 60000000) && !net.tcp_failed;
+    uint64_t elapsed_ps = w5x00_host_time_ps() - start_ps;
+    w5x00_stats_t stats;
+    w5x00_get_stats(self, &stats);
+    net_tcp_close();
+    if (!ok) {
+        fprintf(stderr, "tcp %s: %u of %u bytes arrived\n", dir, net.tcp_received, bytes);
+        return false;
+    }
+    double kb = bytes / 1024.0;
+    printf("tcp  %-4s %10u %8.2f %10.1f %10.1f %8.2f %8.2f\n", dir, bytes,
+        bytes * 8.0 / (elapsed_ps / 1e6), stats.spi_bytes / kb, (double)stats.bus_us / kb,
+        stats.irqs / kb, stats.polls / kb);
+    return true;
+}
+
+// UDP flood
+
+static void net_sink_recv(__unused void *arg, __unused struct udp_pcb *pcb, struct pbuf *p, __unused const ip_addr_t *addr, __unused u16_t port) {
+    net.flood_received++;
+    net.flood_bytes += p->tot_len;
+    pbuf_free(p);
+}
+
+static bool net_flood(w5x00_t *self, uint16_t size, uint32_t frames) {
+    w5x00_model_stats_t model_start = net.model.stats;
+    net.flood_received = 0;
+    net.flood_bytes = 0;
+    w5x00_reset_stats(self);
+    ip_addr_t dst;
+    ip_addr_copy(dst, *netif_ip_addr4(&self->netif));
+    uint64_t start_ps = w5x00_host_time_ps();
+    uint32_t sent = 0;
+    while (sent < frames) {
+        // Keep the wire busy, the peer can always send at its full rate
+        while (sent < frames && net.to_chip.count < NET_WIRE_QUEUE_LEN / 2) {
+            struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, size, PBUF_RAM);
+            if (!p) {
+                break;
+            }
+            pbuf_take(p, net_payload, size);
+            udp_sendto(net.flood_pcb, p, &dst, NET_FLOOD_PORT);
+            pbuf_free(p);
+            sent++;
+        }
+        net_poll();
+        w5x00_host_run_until(MAX(MIN(net_wire_next_us(&net.to_chip), time_us_64() + 1000), time_us_64() + 1));
+    }
+    net_run(net_quiet, 1000000);
+    uint64_t elapsed_ps = w5x00_host_time_ps() - start_ps;
+    w5x00_stats_t stats;
+    w5x00_get_stats(self, &stats);
+    uint32_t chip_dropped = net.model.stats.rx_full - model_start.rx_full;
+    printf("udp  %4u %8u %7.1f%% %8.2f %8u %8u %8u %8u %8u %8u\n", size, frames,
+        100.0 * net.flood_received / frames, net.flood_bytes * 8.0 / (elapsed_ps / 1e6),
+        chip_dropped, stats.rx_pbuf_fail, stats.rx_occupancy_max, stats.poll_latency_max_us,
+        w5x00_stats_rx_latency_percentile(&stats, 50), w5x00_stats_rx_latency_percentile(&stats, 99));
+    return true;
+}
+
+static uint net_parse_list(char *arg, uint32_t *list, uint max) {
+    uint count = 0;
+    for (char *tok = strtok(arg, ","); tok && count < max; tok = strtok(NULL, ",")) {
+        list[count++] = (uint32_t)strtoul(tok, NULL, 0);
+    }
+    return count;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-f spi_hz,spi_hz,...] [-n pings] [-s size,size,...] [-t tcp_bytes] [-u udp_frames]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    uint32_t clocks[8] = { 5000000, 20000000, 33000000 };
+    uint clock_count = 3;
+    uint32_t sizes[8] = { 32, 512, 1472 };
+    uint size_count = 3;
+    uint32_t pings = 1000;
+    uint32_t tcp_bytes = 1024 * 1024;
+    uint32_t udp_frames = 5000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:n:s:t:u:")) != -1) {
+        switch (opt) {
+            case 'f': clock_count = net_parse_list(optarg, clocks, count_of(clocks)); break;
+            case 'n': pings = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 's': size_count = net_parse_list(optarg, sizes, count_of(sizes)); break;
+            case 't': tcp_bytes = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'u': udp_frames = (uint32_t)strtoul(optarg, NULL, 0); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (!clock_count || !size_count || !pings || !tcp_bytes || !udp_frames) {
+        usage(argv[0]);
+    }
+    for (uint i = 0; i < size_count; i++) {
+        if (sizes[i] < 1 || sizes[i] > 1472) {
+            fprintf(stderr, "UDP payload sizes must be 1 to 1472\n");
+            return 2;
+        }
+    }
+    for (uint i = 0; i < sizeof(net_payload); i++) {
+        net_payload[i] = (uint8_t)i;
+    }
+
+    lwip_init();
+    w5x00_model_init(&net.model);
+    w5x00_model_set_tx_callback(&net.model, net_chip_tx, NULL);
+    const w5x00_hw_config_t hw = W5X00_HW_CONFIG_DEFAULT;
+    w5x00_host_attach(&net.model, &hw);
+    w5x00_host_set_tick_callback(net_tick, NULL);
+
+    w5x00_t *self = &w5x00_state;
+    if (!w5x00_driver_init(w5x00_host_async_context())) {
+        fprintf(stderr, "w5x00_driver_init failed\n");
+        return 1;
+    }
+    w5x00_ethernet_set_up(self, true);
+    w5x00_ethernet_join(self);
+    w5x00_host_run();
+    if (!netif_is_link_up(&self->netif)) {
+        fprintf(stderr, "the driver's netif didn't come up\n");
+        return 1;
+    }
+
+    ip4_addr_t driver_ip, peer_ip, mask;
+    IP4_ADDR(&driver_ip, 192, 168, 0, 2);
+    IP4_ADDR(&peer_ip, 192, 168, 0, 1);
+    IP4_ADDR(&mask, 255, 255, 255, 0);
+    netif_set_addr(&self->netif, &driver_ip, &mask, &peer_ip);
+    netif_add(&net.peer, &peer_ip, &mask, &driver_ip, NULL, net_peer_init, ethernet_input);
+    netif_set_up(&net.peer);
+    netif_set_link_up(&net.peer);
+
+    ip_addr_t driver_addr, peer_addr;
+    ip_addr_copy_from_ip4(driver_addr, driver_ip);
+    ip_addr_copy_from_ip4(peer_addr, peer_ip);
+    net.echo_pcb = udp_new();
+    udp_bind(net.echo_pcb, &driver_addr, NET_ECHO_PORT);
+    udp_recv(net.echo_pcb, net_echo_recv, NULL);
+    net.ping_pcb = udp_new();
+    udp_bind(net.ping_pcb, &peer_addr, 0);
+    udp_recv(net.ping_pcb, net_pong_recv, NULL);
+    net.sink_pcb = udp_new();
+    udp_bind(net.sink_pcb, &driver_addr, NET_FLOOD_PORT);
+    udp_recv(net.sink_pcb, net_sink_recv, NULL);
+    net.flood_pcb = udp_new();
+    udp_bind(net.flood_pcb, &peer_addr, 0);
+    struct tcp_pcb *listen_pcb = tcp_new();
+    tcp_bind(listen_pcb, &driver_addr, NET_TCP_PORT);
+    net.tcp_listen = tcp_listen(listen_pcb);
+    tcp_accept(net.tcp_listen, net_tcp_accepted);
+
+    bool ok = true;
+    for (uint c = 0; c < clock_count && ok; c++) {
+        w5x00_spi_set_baudrate(self, clocks[c]);
+        uint32_t spi_hz = w5x00_spi_get_baudrate(self);
+        printf("W5x00 driver with lwIP, %s, SPI clock %u Hz (asked for %u)\n",
+            _WIZCHIP_ == W5500 ? "W5500" : "W5100S", spi_hz, clocks[c]);
+        printf("ping size   rtt_p50_us rtt_p90_us rtt_p99_us rtt_max_us  lat_p50  lat_p99 spi/ping\n");
+        for (uint i = 0; i < size_count && ok; i++) {
+            ok = net_ping(self, (uint16_t)sizes[i], pings);
+        }
+        printf("tcp  dir       bytes     Mbps    spi/KB  bus_us/KB  irqs/KB polls/KB\n");
+        ok = ok && net_tcp(self, false, tcp_bytes);
+        ok = ok && net_tcp(self, true, tcp_bytes);
+        printf("udp  size   frames  arrived     Mbps chipdrop pbuffail   occmax  pollmax  lat_p50  lat_p99\n");
+        for (uint i = 0; i < size_count && ok; i++) {
+            ok = net_flood(self, (uint16_t)sizes[i], udp_frames);
+        }
+        printf("\n");
+    }
+    if (net.to_chip.dropped || net.to_peer.dropped || net.peer_pbuf_fail) {
+        fprintf(stderr, "the wire dropped %u frames to the chip and %u to the peer, the peer had no pbuf for %u\n",
+            net.to_chip.dropped, net.to_peer.dropped, net.peer_pbuf_fail);
+    }
+    return ok ? 0 : 1;
+}
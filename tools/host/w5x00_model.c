@@ -0,0 +1,497 @@
+#include <string.h>
+
+#include "w5x00_model.h"
+
+// Register offsets are taken from the ioLibrary's own address macros, so the model can't disagree with it
+#if _WIZCHIP_ == W5500
+#define MODEL_CREG(reg)     ((uint8_t)((reg) >> 8))
+#define MODEL_SREG(reg)     ((uint8_t)((reg(0)) >> 8))
+#else
+#define MODEL_CREG(reg)     ((uint8_t)(reg))
+#define MODEL_SREG(reg)     ((uint8_t)((reg(0)) - Sn_MR(0)))
+#define MODEL_SREG_BASE     ((uint16_t)Sn_MR(0))
+#define MODEL_SREG_STRIDE   ((uint16_t)(Sn_MR(1) - Sn_MR(0)))
+// Fixed by the W5100S memory map
+#define MODEL_TXBUF_BASE    (0x4000)
+#define MODEL_RXBUF_BASE    (0x6000)
+#endif
+
+// What the address phase of an SPI frame selected
+#define MODEL_SPACE_NONE    (0)
+#define MODEL_SPACE_COMMON  (1)
+#define MODEL_SPACE_SOCKET  (2)
+#define MODEL_SPACE_TX      (3)
+#define MODEL_SPACE_RX      (4)
+
+static uint16_t model_sreg16(const w5x00_model_t *model, uint8_t sn, uint8_t off) {
+    return (uint16_t)((model->sreg[sn][off] << 8) | model->sreg[sn][off + 1]);
+}
+
+static void model_set_sreg16(w5x00_model_t *model, uint8_t sn, uint8_t off, uint16_t value) {
+    model->sreg[sn][off] = (uint8_t)(value >> 8);
+    model->sreg[sn][off + 1] = (uint8_t)value;
+}
+
+static uint16_t model_tx_size(const w5x00_model_t *model, uint8_t sn) {
+    return (uint16_t)(model->sreg[sn][MODEL_SREG(Sn_TXBUF_SIZE)] * 1024);
+}
+
+static uint16_t model_rx_size(const w5x00_model_t *model, uint8_t sn) {
+    return (uint16_t)(model->sreg[sn][MODEL_SREG(Sn_RXBUF_SIZE)] * 1024);
+}
+
+// Socket buffers are allocated contiguously in socket order, as on the chip
+static uint16_t model_tx_base(const w5x00_model_t *model, uint8_t sn) {
+    uint32_t base = 0;
+    for (uint8_t i = 0; i < sn; i++) {
+        base += model_tx_size(model, i);
+    }
+    return (uint16_t)base;
+}
+
+static uint16_t model_rx_base(const w5x00_model_t *model, uint8_t sn) {
+    uint32_t base = 0;
+    for (uint8_t i = 0; i < sn; i++) {
+        base += model_rx_size(model, i);
+    }
+    return (uint16_t)base;
+}
+
+static uint8_t *model_tx_byte(w5x00_model_t *model, uint8_t sn, uint16_t ptr) {
+    uint16_t size = model_tx_size(model, sn);
+    uint32_t offset = model_tx_base(model, sn) + (size ? (ptr & (size - 1)) : 0);
+    return offset < W5X00_MODEL_MEM_SIZE ? &model->tx_mem[offset] : NULL;
+}
+
+static uint8_t *model_rx_byte(w5x00_model_t *model, uint8_t sn, uint16_t ptr) {
+    uint16_t size = model_rx_size(model, sn);
+    uint32_t offset = model_rx_base(model, sn) + (size ? (ptr & (size - 1)) : 0);
+    return offset < W5X00_MODEL_MEM_SIZE ? &model->rx_mem[offset] : NULL;
+}
+
+static uint8_t model_socket_irqs(const w5x00_model_t *model) {
+    uint8_t sir = 0;
+    for (uint8_t sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+        if (model->sreg[sn][MODEL_SREG(Sn_IR)]) {
+            sir |= (uint8_t)(1u << sn);
+        }
+    }
+    return sir;
+}
+
+static void model_reset(w5x00_model_t *model) {
+    memset(model->creg, 0, sizeof(model->creg));
+    memset(model->sreg, 0, sizeof(model->sreg));
+    memset(model->tx_rd, 0, sizeof(model->tx_rd));
+    memset(model->rx_wr, 0, sizeof(model->rx_wr));
+    memset(model->rx_rd, 0, sizeof(model->rx_rd));
+    #if _WIZCHIP_ == W5500
+    model->creg[MODEL_CREG(PHYCFGR)] = 0xb8;
+    model->creg[MODEL_CREG(VERSIONR)] = 0x04;
+    #else
+    model->creg[MODEL_CREG(VER)] = 0x51;
+    #endif
+    for (uint8_t sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+        model->sreg[sn][MODEL_SREG(Sn_SR)] = SOCK_CLOSED;
+        model->sreg[sn][MODEL_SREG(Sn_IMR)] = 0xff;
+        model->sreg[sn][MODEL_SREG(Sn_TXBUF_SIZE)] = 2;
+        model->sreg[sn][MODEL_SREG(Sn_RXBUF_SIZE)] = 2;
+    }
+}
+
+void w5x00_model_init(w5x00_model_t *model) {
+    memset(model, 0, sizeof(*model));
+    model_reset(model);
+    model->link_up = true;
+}
+
+void w5x00_model_set_reset(w5x00_model_t *model, bool in_reset) {
+    if (in_reset && !model->in_reset) {
+        model_reset(model);
+    }
+    model->in_reset = in_reset;
+}
+
+bool w5x00_model_intn(const w5x00_model_t *model) {
+    if (model->in_reset) {
+        return true;
+    }
+    uint8_t sir = 0;
+    for (uint8_t sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+        if (model->sreg[sn][MODEL_SREG(Sn_IR)] & model->sreg[sn][MODEL_SREG(Sn_IMR)]) {
+            sir |= (uint8_t)(1u << sn);
+        }
+    }
+    #if _WIZCHIP_ == W5500
+    bool active = (sir & model->creg[MODEL_CREG(SIMR)]) ||
+                  (model->creg[MODEL_CREG(IR)] & model->creg[MODEL_CREG(_IMR_)] & 0xf0);
+    #else
+    // The socket interrupts share IR and IMR with the others, and MR2 gates the pin
+    uint8_t ir = (uint8_t)((model->creg[MODEL_CREG(IR)] & 0xf0) | sir);
+    bool active = (model->creg[MODEL_CREG(MR2)] & MR2_G_IEN) && (ir & model->creg[MODEL_CREG(_IMR_)]);
+    #endif
+    return !active;
+}
+
+void w5x00_model_set_link(w5x00_model_t *model, bool up) {
+    model->link_up = up;
+}
+
+void w5x00_model_set_tx_callback(w5x00_model_t *model, w5x00_model_tx_cb_t cb, void *arg) {
+    model->tx_cb = cb;
+    model->tx_cb_arg = arg;
+}
+
+static uint8_t model_read_common(const w5x00_model_t *model, uint16_t off) {
+    if (off >= sizeof(model->creg)) {
+        return 0;
+    }
+    #if _WIZCHIP_ == W5500
+    if (off == MODEL_CREG(SIR)) {
+        return model_socket_irqs(model);
+    }
+    if (off == MODEL_CREG(PHYCFGR)) {
+        uint8_t cfgr = model->creg[off] & 0xf8;
+        return model->link_up ? (uint8_t)(cfgr | PHYCFGR_LNK_ON | PHYCFGR_SPD_100 | PHYCFGR_DPX_FULL) : cfgr;
+    }
+    #else
+    if (off == MODEL_CREG(IR)) {
+        return (uint8_t)((model->creg[off] & 0xf0) | model_socket_irqs(model));
+    }
+    if (off == MODEL_CREG(PHYSR)) {
+        // 100M full duplex is shown by SPD and DPX being clear
+        return model->link_up ? PHYSR_LNK : 0;
+    }
+    #endif
+    return model->creg[off];
+}
+
+static void model_write_common(w5x00_model_t *model, uint16_t off, uint8_t value) {
+    if (off >= sizeof(model->creg)) {
+        return;
+    }
+    if (off == MODEL_CREG(MR) && (value & MR_RST)) {
+        model_reset(model);
+        return;
+    }
+    if (off == MODEL_CREG(IR)) {
+        // write 1 to clear
+        model->creg[off] &= (uint8_t)~value;
+        return;
+    }
+    #if _WIZCHIP_ == W5500
+    if (off == MODEL_CREG(SIR) || off == MODEL_CREG(VERSIONR)) {
+        return;
+    }
+    #else
+    if (off == MODEL_CREG(PHYSR) || off == MODEL_CREG(VER)) {
+        return;
+    }
+    #endif
+    model->creg[off] = value;
+}
+
+static void model_send(w5x00_model_t *model, uint8_t sn) {
+    static uint8_t frame[W5X00_MODEL_MEM_SIZE];
+    uint16_t wr = model_sreg16(model, sn, MODEL_SREG(Sn_TX_WR));
+    uint16_t len = (uint16_t)(wr - model->tx_rd[sn]);
+    if (len > model_tx_size(model, sn)) {
+        len = 0;
+    }
+    for (uint16_t i = 0; i < len; i++) {
+        frame[i] = *model_tx_byte(model, sn, (uint16_t)(model->tx_rd[sn] + i));
+    }
+    model->tx_rd[sn] = wr;
+    model->stats.tx_frames++;
+    model->stats.tx_bytes += len;
+    if (model->tx_cb && len) {
+        model->tx_cb(model, sn, frame, len, model->tx_cb_arg);
+    }
+    model->sreg[sn][MODEL_SREG(Sn_IR)] |= Sn_IR_SENDOK;
+}
+
+// Commands complete straight away, so Sn_CR always reads back as 0
+static void model_command(w5x00_model_t *model, uint8_t sn, uint8_t cmd) {
+    uint8_t *sr = &model->sreg[sn][MODEL_SREG(Sn_SR)];
+    uint8_t *ir = &model->sreg[sn][MODEL_SREG(Sn_IR)];
+    model->stats.commands++;
+    switch (cmd) {
+        case Sn_CR_OPEN:
+            switch (model->sreg[sn][MODEL_SREG(Sn_MR)] & 0x0f) {
+                case Sn_MR_TCP: *sr = SOCK_INIT; break;
+                case Sn_MR_UDP: *sr = SOCK_UDP; break;
+                case Sn_MR_MACRAW: *sr = SOCK_MACRAW; break;
+                default: *sr = SOCK_CLOSED; break;
+            }
+            model->tx_rd[sn] = model->rx_wr[sn] = model->rx_rd[sn] = 0;
+            model_set_sreg16(model, sn, MODEL_SREG(Sn_TX_WR), 0);
+            model_set_sreg16(model, sn, MODEL_SREG(Sn_RX_RD), 0);
+            break;
+        case Sn_CR_CLOSE:
+            *sr = SOCK_CLOSED;
+            break;
+        case Sn_CR_LISTEN:
+            if (*sr == SOCK_INIT) {
+                *sr = SOCK_LISTEN;
+            }
+            break;
+        case Sn_CR_CONNECT:
+            // Nothing on the wire answers
+            if (*sr == SOCK_INIT) {
+                *sr = SOCK_CLOSED;
+                *ir |= Sn_IR_TIMEOUT;
+            }
+            break;
+        case Sn_CR_DISCON:
+            *sr = SOCK_CLOSED;
+            *ir |= Sn_IR_DISCON;
+            break;
+        case Sn_CR_SEND:
+        case Sn_CR_SEND_MAC:
+        case Sn_CR_SEND_KEEP:
+            if (*sr != SOCK_CLOSED) {
+                model_send(model, sn);
+            }
+            break;
+        case Sn_CR_RECV:
+            model->rx_rd[sn] = model_sreg16(model, sn, MODEL_SREG(Sn_RX_RD));
+            break;
+        default:
+            break;
+    }
+}
+
+static uint8_t model_read_socket(w5x00_model_t *model, uint8_t sn, uint16_t off) {
+    if (sn >= _WIZCHIP_SOCK_NUM_ || off >= sizeof(model->sreg[0])) {
+        return 0;
+    }
+    uint8_t fsr = MODEL_SREG(Sn_TX_FSR);
+    uint8_t rsr = MODEL_SREG(Sn_RX_RSR);
+    uint8_t txrd = MODEL_SREG(Sn_TX_RD);
+    if (off == fsr || off == fsr + 1) {
+        uint16_t used = (uint16_t)(model_sreg16(model, sn, MODEL_SREG(Sn_TX_WR)) - model->tx_rd[sn]);
+        uint16_t free = (uint16_t)(model_tx_size(model, sn) - used);
+        return off == fsr ? (uint8_t)(free >> 8) : (uint8_t)free;
+    }
+    if (off == rsr || off == rsr + 1) {
+        uint16_t used = (uint16_t)(model->rx_wr[sn] - model->rx_rd[sn]);
+        return off == rsr ? (uint8_t)(used >> 8) : (uint8_t)used;
+    }
+    if (off == txrd || off == txrd + 1) {
+        return off == txrd ? (uint8_t)(model->tx_rd[sn] >> 8) : (uint8_t)model->tx_rd[sn];
+    }
+    if (off == MODEL_SREG(Sn_CR)) {
+        return 0;
+    }
+    return model->sreg[sn][off];
+}
+
+static void model_write_socket(w5x00_model_t *model, uint8_t sn, uint16_t off, uint8_t value) {
+    if (sn >= _WIZCHIP_SOCK_NUM_ || off >= sizeof(model->sreg[0])) {
+        return;
+    }
+    if (off == MODEL_SREG(Sn_CR)) {
+        model_command(model, sn, value);
+    } else if (off == MODEL_SREG(Sn_IR)) {
+        model->sreg[sn][off] &= (uint8_t)~value;
+    } else if (off != MODEL_SREG(Sn_SR)) {
+        model->sreg[sn][off] = value;
+    }
+}
+
+// Work out which register or buffer byte the current address points at
+static uint8_t model_decode(const w5x00_model_t *model, uint8_t *sn, uint16_t *off) {
+    #if _WIZCHIP_ == W5500
+    uint8_t bsb = model->hdr[2] >> 3;
+    *off = model->addr;
+    if (bsb == 0) {
+        *sn = 0;
+        return MODEL_SPACE_COMMON;
+    }
+    *sn = (uint8_t)((bsb - 1) >> 2);
+    switch ((bsb - 1) & 3) {
+        case 0: return MODEL_SPACE_SOCKET;
+        case 1: return MODEL_SPACE_TX;
+        case 2: return MODEL_SPACE_RX;
+        default: return MODEL_SPACE_NONE;
+    }
+    #else
+    uint16_t addr = model->addr;
+    *sn = 0;
+    if (addr < MODEL_SREG_BASE) {
+        *off = addr;
+        return MODEL_SPACE_COMMON;
+    }
+    if (addr < MODEL_SREG_BASE + _WIZCHIP_SOCK_NUM_ * MODEL_SREG_STRIDE) {
+        *sn = (uint8_t)((addr - MODEL_SREG_BASE) / MODEL_SREG_STRIDE);
+        *off = (uint16_t)((addr - MODEL_SREG_BASE) % MODEL_SREG_STRIDE);
+        return MODEL_SPACE_SOCKET;
+    }
+    if (addr >= MODEL_TXBUF_BASE && addr < MODEL_TXBUF_BASE + W5X00_MODEL_MEM_SIZE) {
+        *off = (uint16_t)(addr - MODEL_TXBUF_BASE);
+        return MODEL_SPACE_TX;
+    }
+    if (addr >= MODEL_RXBUF_BASE && addr < MODEL_RXBUF_BASE + W5X00_MODEL_MEM_SIZE) {
+        *off = (uint16_t)(addr - MODEL_RXBUF_BASE);
+        return MODEL_SPACE_RX;
+    }
+    return MODEL_SPACE_NONE;
+    #endif
+}
+
+// The W5500 addresses socket buffers by pointer, wrapping within the socket's buffer.
+// The W5100S addresses its buffer memory directly
+static uint8_t *model_buf_byte(w5x00_model_t *model, uint8_t space, uint8_t sn, uint16_t off) {
+    #if _WIZCHIP_ == W5500
+    return space == MODEL_SPACE_TX ? model_tx_byte(model, sn, off) : model_rx_byte(model, sn, off);
+    #else
+    (void)sn;
+    return space == MODEL_SPACE_TX ? &model->tx_mem[off] : &model->rx_mem[off];
+    #endif
+}
+
+static uint8_t model_access(w5x00_model_t *model, uint8_t mosi) {
+    uint8_t sn;
+    uint16_t off;
+    uint8_t space = model_decode(model, &sn, &off);
+    uint8_t miso = 0;
+    switch (space) {
+        case MODEL_SPACE_COMMON:
+            if (model->write) {
+                model_write_common(model, off, mosi);
+            } else {
+                miso = model_read_common(model, off);
+            }
+            break;
+        case MODEL_SPACE_SOCKET:
+            if (model->write) {
+                model_write_socket(model, sn, off, mosi);
+            } else {
+                miso = model_read_socket(model, sn, off);
+            }
+            break;
+        case MODEL_SPACE_TX:
+        case MODEL_SPACE_RX: {
+            uint8_t *p = model_buf_byte(model, space, sn, off);
+            if (!p) {
+                break;
+            }
+            if (model->write) {
+                *p = mosi;
+            } else {
+                miso = *p;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    model->addr++;
+    return miso;
+}
+
+void w5x00_model_select(w5x00_model_t *model, bool selected) {
+    model->selected = selected && !model->in_reset;
+    model->hdr_len = 0;
+}
+
+uint8_t w5x00_model_transfer(w5x00_model_t *model, uint8_t mosi) {
+    if (!model->selected) {
+        return 0xff;
+    }
+    if (model->hdr_len < sizeof(model->hdr)) {
+        // Address phase, the chip drives nothing useful
+        model->hdr[model->hdr_len++] = mosi;
+        if (model->hdr_len == sizeof(model->hdr)) {
+            #if _WIZCHIP_ == W5500
+            model->addr = (uint16_t)((model->hdr[0] << 8) | model->hdr[1]);
+            model->write = (model->hdr[2] & 0x04) != 0;
+            #else
+            model->addr = (uint16_t)((model->hdr[1] << 8) | model->hdr[2]);
+            model->write = model->hdr[0] == 0xf0;
+            #endif
+        }
+        return 0;
+    }
+    return model_access(model, mosi);
+}
+
+static uint8_t model_macraw_socket(const w5x00_model_t *model) {
+    for (uint8_t sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+        if (model->sreg[sn][MODEL_SREG(Sn_SR)] == SOCK_MACRAW) {
+            return sn;
+        }
+    }
+    return _WIZCHIP_SOCK_NUM_;
+}
+
+static bool model_macraw_accept(const w5x00_model_t *model, uint8_t sn, const uint8_t *frame, uint16_t len) {
+    if (len < 14) {
+        return false;
+    }
+    uint8_t mr = model->sreg[sn][MODEL_SREG(Sn_MR)];
+    bool bcast = memcmp(frame, "\xff\xff\xff\xff\xff\xff", 6) == 0;
+    bool mcast = !bcast && (frame[0] & 1);
+    bool ipv6 = frame[12] == 0x86 && frame[13] == 0xdd;
+    bool mac_filter = false, bcast_block = false, mcast_block = false, ipv6_block = false;
+    #ifdef Sn_MR_MFEN
+    mac_filter = mr & Sn_MR_MFEN;
+    #endif
+    #if _WIZCHIP_ == W5500
+    bcast_block = mr & Sn_MR_BCASTB;
+    mcast_block = mr & Sn_MR_MMB;
+    ipv6_block = mr & Sn_MR_MIP6B;
+    #else
+    (void)mr;
+    uint8_t mr2 = model->sreg[sn][MODEL_SREG(Sn_MR2)];
+    bcast_block = mr2 & Sn_MR2_MBBLK;
+    mcast_block = mr2 & Sn_MR2_MMBLK;
+    ipv6_block = mr2 & Sn_MR2_IPV6BLK;
+    #endif
+    if (mac_filter && !bcast && !mcast && memcmp(frame, &model->creg[MODEL_CREG(SHAR)], 6) != 0) {
+        return false;
+    }
+    return !((bcast && bcast_block) || (mcast && mcast_block) || (ipv6 && ipv6_block));
+}
+
+int w5x00_model_rx_frame(w5x00_model_t *model, const uint8_t *frame, uint16_t len) {
+    uint8_t sn = model_macraw_socket(model);
+    if (model->in_reset || !model->link_up || sn == _WIZCHIP_SOCK_NUM_) {
+        model->stats.rx_closed++;
+        return W5X00_MODEL_RX_CLOSED;
+    }
+    if (!model_macraw_accept(model, sn, frame, len)) {
+        model->stats.rx_filtered++;
+        return W5X00_MODEL_RX_FILTERED;
+    }
+    uint16_t used = (uint16_t)(model->rx_wr[sn] - model->rx_rd[sn]);
+    if ((uint32_t)used + 2 + len > model_rx_size(model, sn)) {
+        model->stats.rx_full++;
+        return W5X00_MODEL_RX_FULL;
+    }
+    // MACRAW frames are preceded by a 2 byte big-endian length that includes itself
+    uint16_t ptr = model->rx_wr[sn];
+    *model_rx_byte(model, sn, ptr++) = (uint8_t)((len + 2) >> 8);
+    *model_rx_byte(model, sn, ptr++) = (uint8_t)(len + 2);
+    for (uint16_t i = 0; i < len; i++) {
+        *model_rx_byte(model, sn, ptr++) = frame[i];
+    }
+    model->rx_wr[sn] = ptr;
+    used = (uint16_t)(used + 2 + len);
+    if (used > model->stats.rx_used_max) {
+        model->stats.rx_used_max = used;
+    }
+    model->stats.rx_frames++;
+    model->sreg[sn][MODEL_SREG(Sn_IR)] |= Sn_IR_RECV;
+    return W5X00_MODEL_RX_OK;
+}
+
+uint16_t w5x00_model_rx_used(const w5x00_model_t *model) {
+    uint8_t sn = model_macraw_socket(model);
+    return sn == _WIZCHIP_SOCK_NUM_ ? 0 : (uint16_t)(model->rx_wr[sn] - model->rx_rd[sn]);
+}
+
+uint16_t w5x00_model_rx_size(const w5x00_model_t *model) {
+    uint8_t sn = model_macraw_socket(model);
+    return sn == _WIZCHIP_SOCK_NUM_ ? 0 : model_rx_size(model, sn);
+}
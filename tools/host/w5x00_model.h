@@ -0,0 +1,84 @@
+#ifndef W5X00_INCLUDED_W5X00_MODEL_H
+#define W5X00_INCLUDED_W5X00_MODEL_H
+
+// Register level model of a W5100S or W5500 (whichever _WIZCHIP_ selects), seen from its SPI
+// pins. It has the chip's registers, socket buffers and commands, enough for the driver's
+// MACRAW and hardware socket paths. The other end of the wire is the harness, which hands it
+// frames with w5x00_model_rx_frame and is given the frames the driver sends
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "wizchip_conf.h"
+
+#if _WIZCHIP_ == W5500
+#define W5X00_MODEL_MEM_SIZE    (16 * 1024)
+#else
+#define W5X00_MODEL_MEM_SIZE    (8 * 1024)
+#endif
+
+// Result of w5x00_model_rx_frame
+#define W5X00_MODEL_RX_OK           (0)
+#define W5X00_MODEL_RX_FULL         (1)     // the RX buffer had no room, the chip drops these silently
+#define W5X00_MODEL_RX_FILTERED     (2)     // refused by MFEN or the MACRAW blocking bits
+#define W5X00_MODEL_RX_CLOSED       (3)     // no MACRAW socket open, or no link
+
+struct _w5x00_model_t;
+typedef void (*w5x00_model_tx_cb_t)(struct _w5x00_model_t *model, uint8_t sn, const uint8_t *buf, uint16_t len, void *arg);
+
+typedef struct _w5x00_model_stats_t {
+    uint32_t rx_frames;     // frames put in the MACRAW RX buffer
+    uint32_t rx_full;       // frames dropped as the RX buffer was full
+    uint32_t rx_filtered;
+    uint32_t rx_closed;
+    uint16_t rx_used_max;   // most bytes waiting in the MACRAW RX buffer
+    uint32_t tx_frames;     // SEND commands
+    uint32_t tx_bytes;
+    uint32_t commands;      // writes to Sn_CR
+} w5x00_model_stats_t;
+
+typedef struct _w5x00_model_t {
+    uint8_t creg[256];      // common registers, by offset
+    uint8_t sreg[_WIZCHIP_SOCK_NUM_][256];  // socket registers, by offset
+    uint8_t tx_mem[W5X00_MODEL_MEM_SIZE];
+    uint8_t rx_mem[W5X00_MODEL_MEM_SIZE];
+    // the chip's own pointers, the registers only hold what the host last wrote
+    uint16_t tx_rd[_WIZCHIP_SOCK_NUM_];
+    uint16_t rx_wr[_WIZCHIP_SOCK_NUM_];
+    uint16_t rx_rd[_WIZCHIP_SOCK_NUM_];     // Sn_RX_RD as of the last RECV
+
+    // SPI frame being decoded
+    bool selected;
+    uint8_t hdr[3];
+    uint8_t hdr_len;
+    uint16_t addr;
+    bool write;
+
+    bool in_reset;
+    bool link_up;
+
+    w5x00_model_tx_cb_t tx_cb;
+    void *tx_cb_arg;
+    w5x00_model_stats_t stats;
+} w5x00_model_t;
+
+// Power on, as if RSTn had been pulsed, with the link up
+void w5x00_model_init(w5x00_model_t *model);
+
+// Pins
+void w5x00_model_set_reset(w5x00_model_t *model, bool in_reset);
+void w5x00_model_select(w5x00_model_t *model, bool selected);
+uint8_t w5x00_model_transfer(w5x00_model_t *model, uint8_t mosi);
+// Level of INTn, which is active low
+bool w5x00_model_intn(const w5x00_model_t *model);
+
+// Wire
+void w5x00_model_set_link(w5x00_model_t *model, bool up);
+void w5x00_model_set_tx_callback(w5x00_model_t *model, w5x00_model_tx_cb_t cb, void *arg);
+// A frame (without FCS) arriving at the PHY, returns a W5X00_MODEL_RX_* result
+int w5x00_model_rx_frame(w5x00_model_t *model, const uint8_t *frame, uint16_t len);
+// Bytes waiting in the MACRAW socket's RX buffer, and its size
+uint16_t w5x00_model_rx_used(const w5x00_model_t *model);
+uint16_t w5x00_model_rx_size(const w5x00_model_t *model);
+
+#endif
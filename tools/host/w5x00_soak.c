@@ -0,0 +1,631 @@
+// Soak and replay driver, run on the host against w5x00_model. Frames arrive at the chip on a 100 Mbit/s
+// wire with the timing of a profile, and the driver takes them through w5x00_poll_func as it would on the
+// target. Afterwards the driver's counters are checked against what the model saw, and the run fails if
+// they don't add up or a limit was broken. Profiles:
+//
+//   steady     frames at -r per second
+//   burst      -B frames back to back every -P us
+//   storm      broadcasts at the wire rate, with every tenth frame unicast to us
+//   FILE.pcap  the frames of a capture, with its timing scaled by -S (0 for back to back)
+//
+// Built without lwIP (w5x00_soak) the frames go to w5x00_cb_process_ethernet here, and an application
+// holding up to -q frames takes one every -c us, or each as it arrives with -c 0. Built with lwIP
+// (w5x00_lwip_soak) they go through the real w5x00_lwip.c glue to a netif->input standing in for
+// tcpip_input, whose mailbox holds -q frames and is emptied the same way. The pbufs held there come
+// from the pool the driver allocates from, so a slow consumer shows as rx_pbuf_fail and a full
+// mailbox as rx_input_fail. Built with W5X00_PIPE (w5x00_pipe_soak) core 1 reads the frames into the RX
+// slots and core 0 delivers them, the host taking a pass of each in turn
+//
+// Usage: w5x00_soak [-p profile] [-d ms] [-s min_size,max_size] [-r per_second] [-B frames] [-P us]
+//                   [-S speed] [-q depth] [-c us] [-f spi_hz] [-L per_second,burst] [-l max_poll_latency_us]
+//                   [-x] [-i report_ms]
+//   -x fails the run if any frame is dropped
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico/w5x00_driver.h"
+#include "w5x00_host.h"
+#include "w5x00_spi.h"
+#include "socket.h"
+
+#if W5X00_PIPE
+#include "w5x00_pipe.h"
+#endif
+#if W5X00_LWIP
+#include "lwip/init.h"
+#include "lwip/pbuf.h"
+#include "lwip/timeouts.h"
+#endif
+
+#define SOAK_ETHERTYPE      (0x88b5)    // local experimental
+#define SOAK_HDR_LEN        (14 + 4)    // ethernet header and sequence number
+#define SOAK_WIRE_OVERHEAD  (8 + 4 + 12)
+#define SOAK_WIRE_PS_PER_BIT (10000ull)
+#define SOAK_MAX_QUEUE      (256)
+
+static const uint8_t soak_src_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const uint8_t soak_broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+typedef enum {
+    SOAK_STEADY,
+    SOAK_BURST,
+    SOAK_STORM,
+    SOAK_PCAP,
+} soak_profile_t;
+
+// A frame of a capture, at offset in soak.pcap_data
+typedef struct {
+    uint64_t at_ps;
+    uint32_t offset;
+    uint16_t len;
+} soak_pcap_frame_t;
+
+static struct {
+    w5x00_model_t model;
+    uint8_t mac[6];
+
+    // the profile
+    soak_profile_t profile;
+    uint64_t duration_ps;
+    uint16_t min_size;
+    uint16_t max_size;
+    uint32_t rate;
+    uint32_t burst_frames;
+    uint32_t burst_period_us;
+    double speed;
+    uint8_t *pcap_data;
+    soak_pcap_frame_t *pcap_frames;
+    uint32_t pcap_count;
+
+    // frames put on the wire to the chip
+    uint64_t start_ps;
+    uint64_t next_ps;       // when the next frame is due to start on the wire
+    uint64_t wire_idle_ps;
+    uint32_t offered;
+    uint32_t seq;
+    uint32_t rand;
+    bool generated;         // the profile has run out of frames
+    uint64_t last_frame_ps;
+    uint8_t frame[W5X00_MAX_FRAME_SIZE];
+
+    // the receiving application, which takes a frame every consume_us
+    uint32_t queue_len;
+    uint32_t consume_us;
+    uint64_t next_consume_us;
+    #if W5X00_LWIP
+    struct pbuf *queue[SOAK_MAX_QUEUE];
+    uint32_t queue_head;
+    #endif
+    uint32_t queued;
+    uint32_t delivered;     // frames given to the application, taken or not
+    uint32_t app_dropped;   // frames the application had no room for
+    uint32_t consumed;
+
+    // what arrived, synthetic frames only
+    uint32_t next_seq;
+    uint32_t lost;
+    uint32_t reordered;
+    uint32_t corrupted;
+    uint32_t link_lost;
+
+    uint32_t failures;
+} soak;
+
+#define SOAK_CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL: " __VA_ARGS__); \
+        printf("\n"); \
+        soak.failures++; \
+    } \
+} while (0)
+
+// Frames, as for w5x00_bench
+
+static uint32_t soak_random(void) {
+    soak.rand = soak.rand * 1103515245 + 12345;
+    return soak.rand >> 8;
+}
+
+static void soak_build_frame(uint8_t *frame, const uint8_t *dst, uint32_t seq, uint16_t size) {
+    memcpy(frame, dst, 6);
+    memcpy(frame + 6, soak_src_mac, 6);
+    frame[12] = SOAK_ETHERTYPE >> 8;
+    frame[13] = SOAK_ETHERTYPE & 0xff;
+    memcpy(frame + 14, &seq, 4);
+    for (uint i = SOAK_HDR_LEN; i < size; i++) {
+        frame[i] = (uint8_t)(seq + i);
+    }
+}
+
+// Check a frame that has come through the driver. Frames can be dropped, but never reordered or changed
+static void soak_check_frame(const uint8_t *frame, uint16_t len) {
+    if (len < SOAK_HDR_LEN || ((frame[12] << 8) | frame[13]) != SOAK_ETHERTYPE) {
+        return;
+    }
+    uint32_t seq;
+    memcpy(&seq, frame + 14, 4);
+    uint8_t want[W5X00_MAX_FRAME_SIZE];
+    soak_build_frame(want, frame, seq, len);
+    if (memcmp(frame, want, len) != 0) {
+        soak.corrupted++;
+        return;
+    }
+    if (seq < soak.next_seq) {
+        soak.reordered++;
+        return;
+    }
+    soak.lost += seq - soak.next_seq;
+    soak.next_seq = seq + 1;
+}
+
+// Generator, run from the tick callback as time passes
+
+static uint16_t soak_size(void) {
+    if (soak.max_size <= soak.min_size) {
+        return soak.min_size;
+    }
+    return (uint16_t)(soak.min_size + soak_random() % (soak.max_size - soak.min_size + 1u));
+}
+
+// Make the next frame of the profile and work out when it's due, false once there are no more
+static bool soak_next_frame(uint16_t *len) {
+    uint64_t at_ps;
+    const uint8_t *dst = soak.mac;
+    switch (soak.profile) {
+        case SOAK_STEADY:
+            at_ps = soak.offered * 1000000000000ull / soak.rate;
+            break;
+        case SOAK_BURST:
+            at_ps = (soak.offered / soak.burst_frames) * soak.burst_period_us * 1000000ull;
+            break;
+        case SOAK_STORM:
+            at_ps = soak.wire_idle_ps - soak.start_ps;
+            if (soak.offered % 10) {
+                dst = soak_broadcast;
+            }
+            break;
+        case SOAK_PCAP: {
+            if (soak.offered >= soak.pcap_count) {
+                return false;
+            }
+            const soak_pcap_frame_t *f = &soak.pcap_frames[soak.offered];
+            at_ps = soak.speed > 0 ? (uint64_t)(f->at_ps / soak.speed) : 0;
+            *len = f->len;
+            memcpy(soak.frame, soak.pcap_data + f->offset, f->len);
+            soak.next_ps = MAX(soak.start_ps + at_ps, soak.wire_idle_ps);
+            return true;
+        }
+        default:
+            return false;
+    }
+    if (at_ps >= soak.duration_ps) {
+        return false;
+    }
+    *len = soak_size();
+    soak_build_frame(soak.frame, dst, soak.seq++, *len);
+    soak.next_ps = MAX(soak.start_ps + at_ps, soak.wire_idle_ps);
+    return true;
+}
+
+static uint16_t soak_frame_len;
+
+static void soak_consume(void);
+
+static void soak_tick(__unused uint64_t now_us, __unused void *arg) {
+    uint64_t now_ps = w5x00_host_time_ps();
+    while (!soak.generated) {
+        // A frame reaches the chip once its last bit is in
+        uint64_t done_ps = soak.next_ps + (MAX(soak_frame_len, 60) + SOAK_WIRE_OVERHEAD) * 8 * SOAK_WIRE_PS_PER_BIT;
+        if (done_ps > now_ps) {
+            break;
+        }
+        w5x00_model_rx_frame(&soak.model, soak.frame, soak_frame_len);
+        soak.offered++;
+        soak.wire_idle_ps = done_ps;
+        soak.last_frame_ps = done_ps;
+        soak.generated = !soak_next_frame(&soak_frame_len);
+    }
+    #if W5X00_PIPE
+    // Time only passes here while core 1 has the bus, and meanwhile the application runs on core 0
+    soak_consume();
+    #endif
+}
+
+static uint64_t soak_next_frame_us(void) {
+    if (soak.generated) {
+        return UINT64_MAX;
+    }
+    uint64_t done_ps = soak.next_ps + (MAX(soak_frame_len, 60) + SOAK_WIRE_OVERHEAD) * 8 * SOAK_WIRE_PS_PER_BIT;
+    return (done_ps + 999999) / 1000000;
+}
+
+// pcap files, classic format with Ethernet frames
+
+static uint32_t soak_pcap_u32(const uint8_t *p, bool swap) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static bool soak_load_pcap(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    soak.pcap_data = malloc(size > 0 ? (size_t)size : 1);
+    if (size < 24 || fread(soak.pcap_data, 1, (size_t)size, f) != (size_t)size) {
+        fprintf(stderr, "%s: too short\n", path);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+
+    const uint8_t *hdr = soak.pcap_data;
+    uint32_t magic = soak_pcap_u32(hdr, false);
+    bool swap = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+    magic = soak_pcap_u32(hdr, swap);
+    if (magic != 0xa1b2c3d4 && magic != 0xa1b23c4d) {
+        fprintf(stderr, "%s: not a pcap file\n", path);
+        return false;
+    }
+    uint64_t ps_per_tick = magic == 0xa1b23c4d ? 1000 : 1000000;
+    if (soak_pcap_u32(hdr + 20, swap) != 1) {
+        fprintf(stderr, "%s: not an Ethernet capture\n", path);
+        return false;
+    }
+
+    uint32_t max = (uint32_t)(size / 16);
+    soak.pcap_frames = malloc(max * sizeof(soak_pcap_frame_t));
+    uint64_t first_ps = 0;
+    uint32_t skipped = 0;
+    for (long offset = 24; offset + 16 <= size;) {
+        const uint8_t *rec = soak.pcap_data + offset;
+        uint64_t at_ps = soak_pcap_u32(rec, swap) * 1000000000000ull + soak_pcap_u32(rec + 4, swap) * ps_per_tick;
+        uint32_t len = soak_pcap_u32(rec + 8, swap);
+        offset += 16;
+        if ((uint64_t)offset + len > (uint64_t)size) {
+            break;
+        }
+        if (!soak.pcap_count && !skipped) {
+            first_ps = at_ps;
+        }
+        if (len >= 14 && len <= W5X00_MAX_FRAME_SIZE) {
+            soak_pcap_frame_t *frame = &soak.pcap_frames[soak.pcap_count++];
+            frame->at_ps = at_ps >= first_ps ? at_ps - first_ps : 0;
+            frame->offset = (uint32_t)offset;
+            frame->len = (uint16_t)len;
+        } else {
+            skipped++;
+        }
+        offset += len;
+    }
+    if (skipped) {
+        printf("%s: skipped %u frames too long or short for the chip\n", path, skipped);
+    }
+    return soak.pcap_count > 0;
+}
+
+// The receiving end. With -c 0 the application takes each frame as it's delivered, otherwise it only
+// runs between polls, as it would in a NO_SYS application on the one core
+
+#if W5X00_LWIP
+// Stands in for tcpip_input, queueing the frame for the consumer
+static err_t soak_netif_input(struct pbuf *p, __unused struct netif *netif) {
+    soak.delivered++;
+    if (soak.queued == soak.queue_len) {
+        return ERR_MEM;
+    }
+    soak.queue[(soak.queue_head + soak.queued++) % SOAK_MAX_QUEUE] = p;
+    if (!soak.consume_us) {
+        soak_consume();
+    }
+    return ERR_OK;
+}
+
+static void soak_consume_one(void) {
+    struct pbuf *p = soak.queue[soak.queue_head];
+    soak.queue_head = (soak.queue_head + 1) % SOAK_MAX_QUEUE;
+    soak.queued--;
+    uint8_t frame[W5X00_MAX_FRAME_SIZE];
+    uint16_t len = pbuf_copy_partial(p, frame, sizeof(frame), 0);
+    soak_check_frame(frame, len);
+    pbuf_free(p);
+}
+#else
+// The lwIP free callbacks. The MACRAW socket is opened as w5x00_lwip.c does for its netif
+
+void w5x00_cb_tcpip_init(w5x00_t *self) {
+    WIZCHIP_EXPORT(socket)(0, Sn_MR_MACRAW, 0, 0);
+    self->tx_synced = false;
+    setSn_MR(0, getSn_MR(0) | Sn_MR_MFEN);
+    setSn_MR2(0, getSn_MR2(0) & ~(Sn_MR2_MMBLK | Sn_MR2_MBBLK));
+}
+
+void w5x00_cb_tcpip_set_link_up(__unused w5x00_t *self) {
+}
+
+void w5x00_cb_tcpip_set_link_down(__unused w5x00_t *self) {
+    soak.link_lost++;
+}
+
+void w5x00_cb_process_ethernet(void *cb_data, size_t len) {
+    w5x00_t *self = cb_data;
+    soak.delivered++;
+    if (soak.queued == soak.queue_len) {
+        soak.app_dropped++;
+        return;
+    }
+    uint8_t frame[W5X00_MAX_FRAME_SIZE];
+    w5x00_read_ethernet(self, 0, frame, (uint16_t)len);
+    soak_check_frame(frame, (uint16_t)len);
+    soak.queued++;
+    if (!soak.consume_us) {
+        soak_consume();
+    }
+}
+
+static void soak_consume_one(void) {
+    soak.queued--;
+}
+#endif
+
+static void soak_consume(void) {
+    uint64_t now = time_us_64();
+    while (soak.queued && (!soak.consume_us || soak.next_consume_us <= now)) {
+        soak_consume_one();
+        soak.consumed++;
+        if (!soak.consume_us) {
+            continue;
+        }
+        // The application can't have run while the driver had the core, so no catching up
+        soak.next_consume_us = MAX(soak.next_consume_us + soak.consume_us, now + soak.consume_us);
+    }
+}
+
+static uint64_t soak_next_consume_us(void) {
+    return soak.queued && soak.consume_us ? soak.next_consume_us : UINT64_MAX;
+}
+
+static void soak_poll(void) {
+    w5x00_host_run();
+    soak_consume();
+    #if W5X00_LWIP
+    sys_check_timeouts();
+    #endif
+}
+
+static bool soak_quiet(void) {
+    return soak.generated && !soak.queued && !w5x00_model_rx_used(&soak.model);
+}
+
+static void soak_report(uint64_t at_ms, const w5x00_stats_t *s) {
+    printf("%8u %9u %9u %9u %9u %6u %6u %8u %8u\n", (uint32_t)at_ms, soak.offered,
+        soak.model.stats.rx_full, s->rx_frames, soak.delivered, w5x00_model_rx_used(&soak.model),
+        soak.queued, s->rx_pbuf_fail, s->rx_input_fail);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-p steady|burst|storm|FILE.pcap] [-d ms] [-s min_size,max_size] [-r per_second]\n"
+                    "       [-B frames] [-P us] [-S speed] [-q depth] [-c us] [-f spi_hz] [-L per_second,burst]\n"
+                    "       [-l max_poll_latency_us] [-x] [-i report_ms]\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *profile = "burst";
+    uint32_t duration_ms = 1000;
+    uint32_t spi_hz = 0;
+    uint32_t bcast_per_second = 0;
+    uint32_t bcast_burst = 0;
+    uint32_t max_poll_latency_us = 0;
+    uint32_t report_ms = 0;
+    bool no_drops = false;
+    soak.min_size = 60;
+    soak.max_size = 1514;
+    soak.rate = 5000;
+    soak.burst_frames = 16;
+    soak.burst_period_us = 10000;
+    soak.speed = 1;
+    soak.queue_len = 16;
+    soak.consume_us = 20;
+    soak.rand = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:d:s:r:B:P:S:q:c:f:L:l:xi:")) != -1) {
+        switch (opt) {
+            case 'p': profile = optarg; break;
+            case 'd': duration_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 's': {
+                char *end;
+                soak.min_size = (uint16_t)strtoul(optarg, &end, 0);
+                soak.max_size = *end == ',' ? (uint16_t)strtoul(end + 1, NULL, 0) : soak.min_size;
+                break;
+            }
+            case 'r': soak.rate = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'B': soak.burst_frames = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'P': soak.burst_period_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'S': soak.speed = strtod(optarg, NULL); break;
+            case 'q': soak.queue_len = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'c': soak.consume_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'f': spi_hz = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'L': {
+                char *end;
+                bcast_per_second = (uint32_t)strtoul(optarg, &end, 0);
+                bcast_burst = *end == ',' ? (uint32_t)strtoul(end + 1, NULL, 0) : 1;
+                break;
+            }
+            case 'l': max_poll_latency_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'x': no_drops = true; break;
+            case 'i': report_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (!strcmp(profile, "steady")) {
+        soak.profile = SOAK_STEADY;
+    } else if (!strcmp(profile, "burst")) {
+        soak.profile = SOAK_BURST;
+    } else if (!strcmp(profile, "storm")) {
+        soak.profile = SOAK_STORM;
+    } else {
+        soak.profile = SOAK_PCAP;
+        if (!soak_load_pcap(profile)) {
+            return 2;
+        }
+    }
+    if (soak.min_size < SOAK_HDR_LEN || soak.max_size > W5X00_MAX_FRAME_SIZE || soak.min_size > soak.max_size) {
+        fprintf(stderr, "frame sizes must be %u to %u\n", SOAK_HDR_LEN, W5X00_MAX_FRAME_SIZE);
+        return 2;
+    }
+    if (!duration_ms || !soak.rate || !soak.burst_frames || !soak.queue_len || soak.queue_len > SOAK_MAX_QUEUE) {
+        usage(argv[0]);
+    }
+    soak.duration_ps = duration_ms * 1000000000ull;
+
+    #if W5X00_LWIP
+    lwip_init();
+    #endif
+    w5x00_model_init(&soak.model);
+    const w5x00_hw_config_t hw = W5X00_HW_CONFIG_DEFAULT;
+    w5x00_host_attach(&soak.model, &hw);
+
+    w5x00_t *self = &w5x00_state;
+    if (!w5x00_driver_init(w5x00_host_async_context())) {
+        fprintf(stderr, "w5x00_driver_init failed\n");
+        return 1;
+    }
+    #if W5X00_PIPE
+    w5x00_host_start_core1(w5x00_pipe_core1_init, w5x00_pipe_core1_poll);
+    #endif
+    w5x00_ethernet_set_up(self, true);
+    #if W5X00_LWIP
+    w5x00_ethernet_join(self);
+    self->netif.input = soak_netif_input;
+    #endif
+    w5x00_host_run();
+    if (!self->itf_state) {
+        fprintf(stderr, "the chip didn't come up\n");
+        return 1;
+    }
+    if (spi_hz) {
+        w5x00_spi_set_baudrate(self, spi_hz);
+    }
+    spi_hz = w5x00_spi_get_baudrate(self);
+    if (bcast_per_second) {
+        w5x00_set_broadcast_limit(self, bcast_per_second, bcast_burst);
+    }
+    memcpy(soak.mac, self->mac, 6);
+
+    printf("W5x00 soak, %s, SPI clock %u Hz, profile %s, %u frames queued at most, one taken every %u us\n",
+        _WIZCHIP_ == W5500 ? "W5500" : "W5100S", spi_hz, profile, soak.queue_len, soak.consume_us);
+    if (report_ms) {
+        printf("%8s %9s %9s %9s %9s %6s %6s %8s %8s\n", "ms", "offered", "chipdrop", "rx", "delivered",
+            "used", "queued", "pbuffail", "inputfail");
+    }
+
+    // Run the profile, then let the driver catch up
+    w5x00_reset_stats(self);
+    w5x00_model_stats_t model_start = soak.model.stats;
+    soak.start_ps = soak.wire_idle_ps = w5x00_host_time_ps();
+    soak.generated = !soak_next_frame(&soak_frame_len);
+    w5x00_host_set_tick_callback(soak_tick, NULL);
+    uint64_t start_us = time_us_64();
+    uint64_t next_report_us = start_us + report_ms * 1000ull;
+    uint64_t recovered_us = 0;
+    w5x00_stats_t s;
+    for (;;) {
+        soak_poll();
+        uint64_t now = time_us_64();
+        if (report_ms && now >= next_report_us) {
+            w5x00_get_stats(self, &s);
+            soak_report((now - start_us) / 1000, &s);
+            next_report_us += report_ms * 1000ull;
+        }
+        if (soak_quiet()) {
+            recovered_us = now - MIN(now, soak.last_frame_ps / 1000000);
+            break;
+        }
+        if (soak.generated && now > soak.last_frame_ps / 1000000 + 1000000) {
+            break;
+        }
+        uint64_t next = MIN(now + 1000, soak_next_frame_us());
+        next = MIN(next, soak_next_consume_us());
+        if (report_ms) {
+            next = MIN(next, next_report_us);
+        }
+        w5x00_host_run_until(MAX(next, now + 1));
+    }
+    w5x00_host_set_tick_callback(NULL, NULL);
+    w5x00_get_stats(self, &s);
+
+    if (soak.profile != SOAK_PCAP) {
+        soak.lost += soak.seq - soak.next_seq;
+    }
+    const w5x00_model_stats_t *m = &soak.model.stats;
+    uint32_t chip_accepted = m->rx_frames - model_start.rx_frames;
+    uint32_t chip_dropped = m->rx_full - model_start.rx_full;
+    uint32_t chip_filtered = (m->rx_filtered - model_start.rx_filtered) + (m->rx_closed - model_start.rx_closed);
+    uint32_t driver_filtered = s.rx_mcast_filtered + s.rx_rule_filtered + s.rx_bcast_limited;
+    double ms = (soak.last_frame_ps - soak.start_ps) / 1e9;
+    printf("offered   %u frames in %.1f ms\n", soak.offered, ms);
+    printf("chip      %u accepted, %u dropped with the buffer full, %u filtered, at most %u of %u bytes used\n",
+        chip_accepted, chip_dropped, chip_filtered, m->rx_used_max, w5x00_model_rx_size(&soak.model));
+    printf("driver    %u read, %u filtered, %u rx_pbuf_fail, %u rx_input_fail, %u rx_errors\n",
+        s.rx_frames, driver_filtered, s.rx_pbuf_fail, s.rx_input_fail, s.rx_errors);
+    printf("          rx_occupancy_max %u, rx_buf_full %u, poll_latency_max_us %u, latency p50 %u us p99 %u us\n",
+        s.rx_occupancy_max, s.rx_buf_full, s.poll_latency_max_us,
+        w5x00_stats_rx_latency_percentile(&s, 50), w5x00_stats_rx_latency_percentile(&s, 99));
+    printf("app       %u delivered, %u taken, %u dropped, %u lost, %u reordered, %u corrupted\n",
+        soak.delivered, soak.consumed, soak.app_dropped, soak.lost, soak.reordered, soak.corrupted);
+    if (recovered_us || soak_quiet()) {
+        printf("recovery  idle %u us after the last frame\n", (uint32_t)recovered_us);
+    }
+
+    // Everything the chip took has been read, and every frame read is accounted for
+    SOAK_CHECK(soak_quiet(), "the driver didn't catch up within a second of the last frame");
+    SOAK_CHECK(soak.offered == chip_accepted + chip_dropped + chip_filtered,
+        "the chip accounted for %u of %u frames", chip_accepted + chip_dropped + chip_filtered, soak.offered);
+    SOAK_CHECK(s.rx_frames == chip_accepted, "the driver read %u frames, the chip took %u", s.rx_frames, chip_accepted);
+    #if W5X00_LWIP
+    // netif->input saw the frames that got a pbuf, and the ones it refused are rx_input_fail
+    SOAK_CHECK(soak.delivered + s.rx_pbuf_fail + driver_filtered == s.rx_frames,
+        "%u reached netif->input, %u had no pbuf and %u were filtered, of %u read",
+        soak.delivered, s.rx_pbuf_fail, driver_filtered, s.rx_frames);
+    SOAK_CHECK(s.rx_input_fail == soak.delivered - (soak.consumed + soak.queued),
+        "rx_input_fail is %u, netif->input refused %u", s.rx_input_fail, soak.delivered - (soak.consumed + soak.queued));
+    #else
+    SOAK_CHECK(soak.delivered + driver_filtered == s.rx_frames,
+        "%u delivered and %u filtered, of %u read", soak.delivered, driver_filtered, s.rx_frames);
+    SOAK_CHECK(!s.rx_pbuf_fail && !s.rx_input_fail, "rx_pbuf_fail and rx_input_fail are only counted by w5x00_lwip.c");
+    #endif
+    uint32_t dropped = chip_dropped + s.rx_pbuf_fail + s.rx_input_fail + soak.app_dropped;
+    SOAK_CHECK(soak.profile == SOAK_PCAP || soak.lost == dropped + driver_filtered,
+        "%u frames never arrived, %u were dropped or filtered", soak.lost, dropped + driver_filtered);
+    SOAK_CHECK(!soak.reordered && !soak.corrupted, "%u frames arrived out of order and %u corrupted", soak.reordered, soak.corrupted);
+    SOAK_CHECK(!s.rx_errors && !soak.link_lost, "the RX ring was flushed %u times", s.rx_errors);
+
+    // The occupancy the driver saw can't be more than the chip had, and if the chip dropped frames
+    // the driver must have found the buffer too full for another
+    SOAK_CHECK(s.rx_occupancy_max <= m->rx_used_max, "rx_occupancy_max %u is more than the chip held, %u",
+        s.rx_occupancy_max, m->rx_used_max);
+    SOAK_CHECK(!chip_accepted || s.rx_occupancy_max, "rx_occupancy_max is 0 with %u frames read", chip_accepted);
+    SOAK_CHECK(!chip_dropped || s.rx_buf_full, "the chip dropped %u frames but rx_buf_full is 0", chip_dropped);
+    SOAK_CHECK(!max_poll_latency_us || s.poll_latency_max_us <= max_poll_latency_us,
+        "poll_latency_max_us %u is over %u", s.poll_latency_max_us, max_poll_latency_us);
+    if (no_drops) {
+        SOAK_CHECK(!dropped, "%u frames were dropped", dropped);
+    }
+
+    if (soak.failures) {
+        printf("%u checks failed\n", soak.failures);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
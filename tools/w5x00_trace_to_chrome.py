@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Convert the output of w5x00_trace_dump() into Chrome trace JSON.
+
+Usage: w5x00_trace_to_chrome.py capture.txt > trace.json
+
+The capture may contain other console output, only the lines between the
+W5X00 TRACE BEGIN and END markers are used. Open the result in
+https://ui.perfetto.dev or chrome://tracing.
+"""
+
+import json
+import sys
+
+# Must match the W5X00_TRACE_* ids in w5x00_trace.h
+# id: (name, phase, arg name)  phase B/E opens/closes a slice on the core that
+# recorded it, b/e an async slice matched by its arg, i is an instant
+EVENTS = {
+    1: ("irq", "i", "instance"),
+    2: ("poll", "B", "instance"),
+    3: ("poll", "E", "instance"),
+    4: ("spi", "B", "len"),
+    5: ("spi", "E", "len"),
+    6: ("lock", "B", "depth"),
+    7: ("lock", "E", "depth"),
+    8: ("netif_input", "i", "len"),
+    9: ("tx", "B", "len"),
+    10: ("tx", "E", "len"),
+}
+
+
+def parse(lines):
+    inside = False
+    for line in lines:
+        line = line.strip()
+        if line == "W5X00 TRACE BEGIN":
+            inside = True
+        elif line == "W5X00 TRACE END":
+            inside = False
+        elif inside:
+            fields = line.split()
+            if len(fields) == 4:
+                yield tuple(int(f) for f in fields)
+
+
+def convert(lines):
+    out = []
+    base = None
+    last = None
+    for time_us, core, event, arg in parse(lines):
+        # time_us_32 wraps every ~71 minutes, keep the timeline monotonic across a wrap
+        if last is not None and time_us < last and last - time_us > 1 << 31:
+            base += 1 << 32
+        last = time_us
+        if base is None:
+            base = -time_us
+        name, phase, arg_name = EVENTS.get(event, ("event_%d" % event, "i", "arg"))
+        ev = {
+            "name": name,
+            "ph": phase,
+            "ts": time_us + base,
+            "pid": 0,
+            "tid": core,
+            "args": {arg_name: arg},
+        }
+        if phase == "i":
+            ev["s"] = "t"
+        elif phase in "be":
+            # the ends may be on different cores, so pair them by instance
+            ev["cat"] = "w5x00"
+            ev["id"] = arg
+        out.append(ev)
+    meta = [{"name": "thread_name", "ph": "M", "pid": 0, "tid": core, "args": {"name": "core%d" % core}}
+            for core in sorted({e["tid"] for e in out})]
+    return {"traceEvents": meta + out, "displayTimeUnit": "ns"}
+
+
+def main():
+    if len(sys.argv) > 2:
+        sys.exit(__doc__)
+    src = open(sys.argv[1]) if len(sys.argv) == 2 else sys.stdin
+    with src:
+        json.dump(convert(src), sys.stdout)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()